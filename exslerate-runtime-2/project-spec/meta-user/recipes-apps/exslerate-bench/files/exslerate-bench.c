@@ -0,0 +1,190 @@
+/*
+ * exslerate-bench - CPU read bandwidth of ExSLerate BO mappings
+ *
+ * Compares a write-combined BO, a cached BO that is invalidated with
+ * CPU_PREP before every pass, and malloc()ed memory. On arm64 the
+ * write-combined mapping is Normal Non-cacheable memory, so it is also the
+ * uncached case; the driver offers no other uncached mapping.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "exslerate_ioctl.h"
+
+struct bench_bo {
+  uint32_t handle;
+  void *map;
+  size_t size;
+};
+
+static double now_s(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Sum the buffer so the reads cannot be optimised away */
+static uint64_t read_pass(const void *buf, size_t size) {
+  const volatile uint64_t *p = buf;
+  uint64_t sum = 0;
+  size_t i;
+
+  for (i = 0; i < size / sizeof(*p); i++)
+    sum += p[i];
+  return sum;
+}
+
+static int bo_create(int fd, size_t size, uint64_t flags,
+                     struct bench_bo *bo) {
+  struct exsl_drm_create_bo create = {
+      .flags = flags,
+      .size = size,
+      .type = EXSL_BO_SHARE,
+  };
+  struct exsl_gem_map_offset_args map = {0};
+
+  if (ioctl(fd, DRM_IOCTL_EXSL_CREATE_BO, &create)) {
+    perror("CREATE_BO");
+    return -errno;
+  }
+
+  map.handle = create.handle;
+  if (ioctl(fd, DRM_IOCTL_EXSL_GEM_MMAP, &map)) {
+    perror("GEM_MMAP");
+    return -errno;
+  }
+
+  bo->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                 map.map_offset);
+  if (bo->map == MAP_FAILED) {
+    perror("mmap");
+    return -errno;
+  }
+
+  bo->handle = create.handle;
+  bo->size = size;
+  return 0;
+}
+
+static void bo_destroy(int fd, struct bench_bo *bo) {
+  struct exsl_gem_destroy_args destroy = {.handle = bo->handle};
+
+  munmap(bo->map, bo->size);
+  ioctl(fd, DRM_IOCTL_EXSL_GEM_DESTROY, &destroy);
+}
+
+static int cpu_sync(int fd, unsigned long request, uint32_t handle,
+                    uint32_t flags, size_t range) {
+  struct exsl_cpu_sync_args sync = {
+      .handle = handle,
+      .flags = flags,
+      .size = range,
+  };
+
+  if (ioctl(fd, request, &sync)) {
+    perror("CPU sync");
+    return -errno;
+  }
+  return 0;
+}
+
+static void report(const char *name, size_t range, int iters, double secs) {
+  printf("%-8s %8zu KiB x %4d: %8.1f MiB/s\n", name, range >> 10, iters,
+         (double)range * iters / secs / (1 << 20));
+}
+
+int main(int argc, char **argv) {
+  const char *node = "/dev/dri/renderD128";
+  size_t size = 8 << 20, range = 0;
+  struct bench_bo wc, cached;
+  uint64_t sum = 0;
+  int iters = 32;
+  double start;
+  void *host;
+  int fd, opt, i;
+
+  while ((opt = getopt(argc, argv, "d:s:r:n:")) != -1) {
+    switch (opt) {
+    case 'd':
+      node = optarg;
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 0) << 10;
+      break;
+    case 'r':
+      range = strtoul(optarg, NULL, 0) << 10;
+      break;
+    case 'n':
+      iters = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-d node] [-s size_kb] [-r range_kb] [-n iters]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  if (!range || range > size)
+    range = size;
+
+  fd = open(node, O_RDWR);
+  if (fd < 0) {
+    perror(node);
+    return 1;
+  }
+
+  if (bo_create(fd, size, 0, &wc) ||
+      bo_create(fd, size, EXSL_BO_FLAG_CACHED, &cached))
+    return 1;
+
+  host = malloc(size);
+  if (!host)
+    return 1;
+  memset(host, 1, size);
+  memset(wc.map, 1, size);
+  memset(cached.map, 1, size);
+  cpu_sync(fd, DRM_IOCTL_EXSL_CPU_FINI, cached.handle, EXSL_CPU_SYNC_WRITE, 0);
+
+  /* Non-cacheable, write combining only merges stores: loads go to DRAM */
+  start = now_s();
+  for (i = 0; i < iters; i++)
+    sum += read_pass(wc.map, range);
+  report("wc", range, iters, now_s() - start);
+
+  /* Cached reads pay for the invalidate of the range on every pass */
+  start = now_s();
+  for (i = 0; i < iters; i++) {
+    if (cpu_sync(fd, DRM_IOCTL_EXSL_CPU_PREP, cached.handle,
+                 EXSL_CPU_SYNC_READ, range))
+      return 1;
+    sum += read_pass(cached.map, range);
+    cpu_sync(fd, DRM_IOCTL_EXSL_CPU_FINI, cached.handle, EXSL_CPU_SYNC_READ,
+             range);
+  }
+  report("cached", range, iters, now_s() - start);
+
+  start = now_s();
+  for (i = 0; i < iters; i++)
+    sum += read_pass(host, range);
+  report("malloc", range, iters, now_s() - start);
+
+  /* Keeps the sums live */
+  if (!sum)
+    printf("checksum 0\n");
+
+  free(host);
+  bo_destroy(fd, &cached);
+  bo_destroy(fd, &wc);
+  close(fd);
+  return 0;
+}
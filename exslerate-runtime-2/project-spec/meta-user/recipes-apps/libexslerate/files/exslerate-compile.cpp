@@ -0,0 +1,487 @@
+/*
+ * exslerate-compile - compile a convolutional model into an ExSLerate
+ * executable
+ *
+ * The model is a text file, one layer per line, tensors named by the layer
+ * that produces them:
+ *
+ *   input <name> <channels> <height> <width>
+ *   conv <name> <src> filters=<n> kernel=<k>|<kh>x<kw> [stride=<s>|<sh>x<sw>]
+ *        [pad=<p>|<ph>x<pw>] [dilation=<d>|<dh>x<dw>] weights=<file>
+ *        [bias=<file>] [relu] [scale=<n>] [shift=<n>] [zero_point=<n>]
+ *   add <name> <a> <b>
+ *   output <name>
+ *
+ * Weights are int8 FCHW, biases int32, and inputs and outputs int8 NCHW,
+ * in the order the model declares them. Convolutions too big for the conv
+ * core's RAMs are tiled into several passes, dilated ones lowered to
+ * kernels the core runs; those it cannot run at all, and adds, become CPU
+ * layers.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "exslerate_layer.hpp"
+
+namespace {
+
+struct Tensor {
+  uint32_t binding; /* Scratch buffer, in the surface layout */
+  uint32_t channels, height, width;
+};
+
+/* Bindings, layers and relocations of the executable being built */
+class Builder {
+public:
+  uint32_t binding(uint32_t kind, uint64_t size,
+                   std::vector<uint8_t> data = {}) {
+    exsl_exec_binding binding = {};
+
+    binding.size = size;
+    binding.kind = kind;
+    bindings_.push_back(binding);
+    data_.push_back(std::move(data));
+    return bindings_.size() - 1;
+  }
+
+  template <typename T> uint32_t layer(uint32_t core_type, const T &config) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&config);
+
+    layers_.push_back({core_type, {bytes, bytes + sizeof(config)}});
+    return layers_.size() - 1;
+  }
+
+  void reloc(uint32_t layer, uint32_t slot, uint32_t binding,
+             uint64_t offset = 0) {
+    exsl_reloc reloc = {};
+
+    reloc.layer = layer;
+    reloc.slot = slot;
+    reloc.bo_index = binding;
+    reloc.offset = offset;
+    relocs_.push_back(reloc);
+  }
+
+  void write(const std::string &path, uint32_t channel_atom) {
+    exsl_exec_header hdr = {};
+    uint64_t offset;
+
+    /* Constants go after everything else */
+    offset = align(sizeof(hdr)) +
+             bindings_.size() * align(sizeof(exsl_exec_binding));
+    for (const auto &layer : layers_)
+      offset += align(sizeof(exsl_exec_layer)) + align(layer.config.size());
+    offset += relocs_.size() * align(sizeof(exsl_reloc));
+    for (size_t i = 0; i < bindings_.size(); i++) {
+      if (bindings_[i].kind != EXSL_EXEC_BINDING_CONSTANT)
+        continue;
+      bindings_[i].data_offset = offset;
+      offset += align(bindings_[i].size);
+    }
+
+    hdr.magic = EXSL_EXEC_MAGIC;
+    hdr.version = EXSL_EXEC_VERSION;
+    hdr.binding_count = bindings_.size();
+    hdr.layer_count = layers_.size();
+    hdr.reloc_count = relocs_.size();
+    hdr.channel_atom = channel_atom;
+    put(&hdr, sizeof(hdr));
+    for (const auto &binding : bindings_)
+      put(&binding, sizeof(binding));
+    for (const auto &layer : layers_) {
+      exsl_exec_layer hdr_layer = {layer.core_type,
+                                   uint32_t(layer.config.size())};
+
+      put(&hdr_layer, sizeof(hdr_layer));
+      put(layer.config.data(), layer.config.size());
+    }
+    for (const auto &reloc : relocs_)
+      put(&reloc, sizeof(reloc));
+    for (size_t i = 0; i < bindings_.size(); i++)
+      if (bindings_[i].kind == EXSL_EXEC_BINDING_CONSTANT)
+        put(data_[i].data(), data_[i].size());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(reinterpret_cast<const char *>(image_.data()),
+                    image_.size()))
+      throw std::runtime_error(path + ": write failed");
+  }
+
+private:
+  struct Layer {
+    uint32_t core_type;
+    std::vector<uint8_t> config;
+  };
+
+  static uint64_t align(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+  void put(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+    image_.insert(image_.end(), bytes, bytes + size);
+    image_.resize(align(image_.size()));
+  }
+
+  std::vector<exsl_exec_binding> bindings_;
+  std::vector<std::vector<uint8_t>> data_; /* Contents of the constants */
+  std::vector<Layer> layers_;
+  std::vector<exsl_reloc> relocs_;
+  std::vector<uint8_t> image_;
+};
+
+class Compiler {
+public:
+  Compiler(const exsl::Target &target, const std::string &dir)
+      : target_(target), dir_(dir) {}
+
+  void line(const std::string &text);
+  void write(const std::string &path) {
+    builder_.write(path, target_.channel_atom);
+  }
+
+private:
+  void input(std::istringstream &in);
+  void conv(std::istringstream &in);
+  void add(std::istringstream &in);
+  void output(std::istringstream &in);
+
+  const Tensor &tensor(const std::string &name) const;
+  void define(const std::string &name, const Tensor &tensor);
+  uint32_t scratch(uint32_t channels, uint32_t height, uint32_t width);
+  std::vector<uint8_t> read(const std::string &path, uint64_t size) const;
+
+  exsl::Target target_;
+  std::string dir_; /* Weights are relative to the model */
+  Builder builder_;
+  std::map<std::string, Tensor> tensors_;
+};
+
+/* "<a>" or "<a>x<b>", into both or each */
+void pair(const std::string &value, uint32_t &a, uint32_t &b) {
+  size_t x = value.find('x');
+
+  a = std::stoul(value.substr(0, x));
+  b = x == std::string::npos ? a : std::stoul(value.substr(x + 1));
+}
+
+const Tensor &Compiler::tensor(const std::string &name) const {
+  auto it = tensors_.find(name);
+
+  if (it == tensors_.end())
+    throw std::runtime_error("unknown tensor " + name);
+  return it->second;
+}
+
+void Compiler::define(const std::string &name, const Tensor &tensor) {
+  if (name.empty() || !tensors_.emplace(name, tensor).second)
+    throw std::runtime_error("bad or duplicate tensor name '" + name + "'");
+}
+
+uint32_t Compiler::scratch(uint32_t channels, uint32_t height,
+                           uint32_t width) {
+  return builder_.binding(
+      EXSL_EXEC_BINDING_SCRATCH,
+      exsl::surface_size(target_, channels, height, width));
+}
+
+std::vector<uint8_t> Compiler::read(const std::string &path,
+                                    uint64_t size) const {
+  std::string full = path[0] == '/' ? path : dir_ + path;
+  std::ifstream file(full, std::ios::binary);
+
+  if (!file)
+    throw std::runtime_error(full + ": cannot open");
+
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  if (data.size() != size)
+    throw std::runtime_error(full + ": expected " + std::to_string(size) +
+                             " bytes");
+  return data;
+}
+
+void Compiler::input(std::istringstream &in) {
+  exsl_exec_cpu_op op = {};
+  std::string name;
+  Tensor t;
+
+  if (!(in >> name >> t.channels >> t.height >> t.width) || !t.channels ||
+      !t.height || !t.width)
+    throw std::runtime_error("input <name> <channels> <height> <width>");
+
+  uint32_t binding =
+      builder_.binding(EXSL_EXEC_BINDING_INPUT,
+                       uint64_t(t.channels) * t.height * t.width);
+  t.binding = scratch(t.channels, t.height, t.width);
+
+  op.op = EXSL_EXEC_CPU_TO_SURFACE;
+  op.shape.channels = t.channels;
+  op.shape.height = t.height;
+  op.shape.width = t.width;
+  uint32_t layer = builder_.layer(EXSL_EXEC_CPU_CORE, op);
+  builder_.reloc(layer, EXSL_EXEC_CPU_SRC, binding);
+  builder_.reloc(layer, EXSL_EXEC_CPU_DST, t.binding);
+  define(name, t);
+}
+
+void Compiler::conv(std::istringstream &in) {
+  exsl_conv_shape shape = {};
+  std::string name, src, arg, weights, bias;
+
+  if (!(in >> name >> src))
+    throw std::runtime_error("conv <name> <src> ...");
+  const Tensor &from = tensor(src);
+
+  shape.channels = from.channels;
+  shape.height = from.height;
+  shape.width = from.width;
+  shape.stride_h = shape.stride_w = 1;
+  shape.dilation_h = shape.dilation_w = 1;
+  shape.scale = 1;
+
+  while (in >> arg) {
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+    if (key == "filters")
+      shape.filters = std::stoul(value);
+    else if (key == "kernel")
+      pair(value, shape.kernel_h, shape.kernel_w);
+    else if (key == "stride")
+      pair(value, shape.stride_h, shape.stride_w);
+    else if (key == "pad")
+      pair(value, shape.pad_h, shape.pad_w);
+    else if (key == "dilation")
+      pair(value, shape.dilation_h, shape.dilation_w);
+    else if (key == "weights")
+      weights = value;
+    else if (key == "bias")
+      bias = value;
+    else if (key == "relu")
+      shape.relu = 1;
+    else if (key == "scale")
+      shape.scale = std::stoul(value);
+    else if (key == "shift")
+      shape.shift = std::stoul(value);
+    else if (key == "zero_point")
+      shape.zero_point = std::stol(value);
+    else
+      throw std::runtime_error("unknown conv argument " + arg);
+  }
+  shape.has_bias = !bias.empty();
+  if (!exsl::conv_shape_valid(shape) || weights.empty() || shape.shift >= 32)
+    throw std::runtime_error("conv " + name + ": invalid shape");
+
+  /* Constants in the layouts the core reads */
+  std::vector<uint8_t> fchw =
+      read(weights, uint64_t(shape.filters) * shape.channels *
+                        shape.kernel_h * shape.kernel_w);
+  std::vector<int8_t> packed = exsl::pack_filters(
+      target_, shape, reinterpret_cast<const int8_t *>(fchw.data()));
+  uint32_t filters = builder_.binding(
+      EXSL_EXEC_BINDING_CONSTANT, packed.size(),
+      std::vector<uint8_t>(packed.begin(), packed.end()));
+  uint32_t biases = 0;
+  if (shape.has_bias)
+    biases = builder_.binding(EXSL_EXEC_BINDING_CONSTANT, shape.filters * 4,
+                              read(bias, uint64_t(shape.filters) * 4));
+
+  Tensor t = {0, shape.filters, exsl::conv_out_h(shape),
+              exsl::conv_out_w(shape)};
+  t.binding = scratch(t.channels, t.height, t.width);
+
+  const char *why = exsl::conv_unsupported(target_, shape);
+  if (why) {
+    exsl_exec_cpu_op op = {};
+
+    fprintf(stderr, "conv %s: %s, running it on the CPU\n", name.c_str(),
+            why);
+    op.op = EXSL_EXEC_CPU_CONV;
+    op.shape = exsl::lower_conv(shape);
+    uint32_t layer = builder_.layer(EXSL_EXEC_CPU_CORE, op);
+    builder_.reloc(layer, EXSL_EXEC_CPU_SRC, from.binding);
+    builder_.reloc(layer, EXSL_EXEC_CPU_SRC1, filters);
+    if (shape.has_bias)
+      builder_.reloc(layer, EXSL_EXEC_CPU_BIAS, biases);
+    builder_.reloc(layer, EXSL_EXEC_CPU_DST, t.binding);
+  } else {
+    exsl::ConvPlan plan = exsl::plan_conv(target_, shape);
+
+    if (plan.passes.size() > 1)
+      fprintf(stderr, "conv %s: %zu passes of %ux%u outputs, %u filter sets\n",
+              name.c_str(), plan.passes.size(), plan.tile_w, plan.tile_h,
+              plan.filter_sets);
+    for (const auto &pass : plan.passes) {
+      uint32_t layer = builder_.layer(EXSL_CONV_CORE, pass.config);
+
+      builder_.reloc(layer, EXSL_RELOC_CONV_IFMAP, from.binding,
+                     pass.input_offset);
+      builder_.reloc(layer, EXSL_RELOC_CONV_FILTER, filters,
+                     pass.filter_offset);
+      if (shape.has_bias)
+        builder_.reloc(layer, EXSL_RELOC_CONV_BIAS, biases, pass.bias_offset);
+      builder_.reloc(layer, EXSL_RELOC_CONV_OUTPUT, t.binding,
+                     pass.output_offset);
+    }
+  }
+  define(name, t);
+}
+
+void Compiler::add(std::istringstream &in) {
+  exsl_exec_cpu_op op = {};
+  std::string name, a, b;
+
+  if (!(in >> name >> a >> b))
+    throw std::runtime_error("add <name> <a> <b>");
+
+  const Tensor &ta = tensor(a), &tb = tensor(b);
+  if (ta.channels != tb.channels || ta.height != tb.height ||
+      ta.width != tb.width)
+    throw std::runtime_error("add " + name + ": shapes differ");
+
+  Tensor t = ta;
+  t.binding = scratch(t.channels, t.height, t.width);
+
+  /* Same layout on both sides, so the surfaces add element by element */
+  op.op = EXSL_EXEC_CPU_ADD;
+  op.size = exsl::surface_size(target_, t.channels, t.height, t.width);
+  uint32_t layer = builder_.layer(EXSL_EXEC_CPU_CORE, op);
+  builder_.reloc(layer, EXSL_EXEC_CPU_SRC, ta.binding);
+  builder_.reloc(layer, EXSL_EXEC_CPU_SRC1, tb.binding);
+  builder_.reloc(layer, EXSL_EXEC_CPU_DST, t.binding);
+  define(name, t);
+}
+
+void Compiler::output(std::istringstream &in) {
+  exsl_exec_cpu_op op = {};
+  std::string name;
+
+  if (!(in >> name))
+    throw std::runtime_error("output <name>");
+
+  const Tensor &t = tensor(name);
+  uint32_t binding =
+      builder_.binding(EXSL_EXEC_BINDING_OUTPUT,
+                       uint64_t(t.channels) * t.height * t.width);
+
+  op.op = EXSL_EXEC_CPU_FROM_SURFACE;
+  op.shape.channels = t.channels;
+  op.shape.height = t.height;
+  op.shape.width = t.width;
+  uint32_t layer = builder_.layer(EXSL_EXEC_CPU_CORE, op);
+  builder_.reloc(layer, EXSL_EXEC_CPU_SRC, t.binding);
+  builder_.reloc(layer, EXSL_EXEC_CPU_DST, binding);
+}
+
+void Compiler::line(const std::string &text) {
+  std::istringstream in(text.substr(0, text.find('#')));
+  std::string op;
+
+  if (!(in >> op))
+    return;
+
+  if (op == "input")
+    input(in);
+  else if (op == "conv")
+    conv(in);
+  else if (op == "add")
+    add(in);
+  else if (op == "output")
+    output(in);
+  else
+    throw std::runtime_error("unknown layer " + op);
+}
+
+/* -t <key>=<value> overrides of the target */
+void override(exsl::Target &target, const std::string &arg) {
+  static const std::map<std::string, uint32_t exsl::Target::*> keys = {
+      {"channel_atom", &exsl::Target::channel_atom},
+      {"ram_banks", &exsl::Target::ram_banks},
+      {"iact_bank_bytes", &exsl::Target::iact_bank_bytes},
+      {"filt_bank_bytes", &exsl::Target::filt_bank_bytes},
+      {"axi_beat_bytes", &exsl::Target::axi_beat_bytes},
+      {"burst_len", &exsl::Target::burst_len},
+  };
+  size_t eq = arg.find('=');
+  auto it = keys.find(arg.substr(0, eq));
+  uint32_t value;
+
+  if (eq == std::string::npos || it == keys.end())
+    throw std::runtime_error("unknown target option " + arg);
+  value = std::stoul(arg.substr(eq + 1));
+  if (!value)
+    throw std::runtime_error("target option " + arg + " must not be 0");
+  /* ifMaxRam and flMaxRam select up to 16 banks */
+  if (it->second == &exsl::Target::ram_banks && value > 16)
+    throw std::runtime_error("at most 16 RAM banks");
+  target.*(it->second) = value;
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-o executable] [-t key=value]... model\n"
+          "Target keys: channel_atom, ram_banks, iact_bank_bytes,\n"
+          "filt_bank_bytes, axi_beat_bytes, burst_len\n",
+          prog);
+  exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string out = "model.exsl";
+  exsl::Target target;
+  int opt;
+
+  try {
+    while ((opt = getopt(argc, argv, "o:t:")) != -1) {
+      switch (opt) {
+      case 'o':
+        out = optarg;
+        break;
+      case 't':
+        override(target, optarg);
+        break;
+      default:
+        usage(argv[0]);
+      }
+    }
+    if (optind != argc - 1)
+      usage(argv[0]);
+
+    std::string path = argv[optind];
+    std::ifstream model(path);
+    std::string text;
+    unsigned lineno = 0;
+
+    if (!model)
+      throw std::runtime_error(path + ": cannot open");
+
+    Compiler compiler(target, path.substr(0, path.rfind('/') + 1));
+    while (std::getline(model, text)) {
+      lineno++;
+      try {
+        compiler.line(text);
+      } catch (const std::exception &e) {
+        throw std::runtime_error(path + ":" + std::to_string(lineno) + ": " +
+                                 e.what());
+      }
+    }
+    compiler.write(out);
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * exslerate-conv-test - check plan_conv() against the CPU convolution
+ *
+ * Runs the passes of each planned convolution through a model of the conv
+ * core, driven only by the pass configs, and compares the output with
+ * EXSL_EXEC_CPU_CONV. The model fails a pass that reads outside the input
+ * surface or its IACT window, so a plan that only happens to produce the
+ * right numbers does not pass either. Runs on the build host: make check.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "exslerate_layer.hpp"
+
+namespace {
+
+struct Case {
+  const char *name;
+  exsl_conv_shape conv;
+  exsl::Target target;
+};
+
+exsl_conv_shape shape(uint32_t channels, uint32_t height, uint32_t width,
+                      uint32_t filters, uint32_t kernel_h, uint32_t kernel_w,
+                      uint32_t stride_h, uint32_t stride_w, uint32_t pad_h,
+                      uint32_t pad_w, uint32_t dilation_h,
+                      uint32_t dilation_w) {
+  exsl_conv_shape conv = {};
+
+  conv.channels = channels;
+  conv.height = height;
+  conv.width = width;
+  conv.filters = filters;
+  conv.kernel_h = kernel_h;
+  conv.kernel_w = kernel_w;
+  conv.stride_h = stride_h;
+  conv.stride_w = stride_w;
+  conv.pad_h = pad_h;
+  conv.pad_w = pad_w;
+  conv.dilation_h = dilation_h;
+  conv.dilation_w = dilation_w;
+  conv.has_bias = 1;
+  conv.scale = 3;
+  conv.shift = 7;
+  conv.zero_point = -2;
+  return conv;
+}
+
+exsl::Target small_rams(uint32_t iact_bank_bytes, uint32_t filt_bank_bytes) {
+  exsl::Target target;
+
+  target.channel_atom = 8;
+  target.ram_banks = 4;
+  target.iact_bank_bytes = iact_bank_bytes;
+  target.filt_bank_bytes = filt_bank_bytes;
+  return target;
+}
+
+/* Deterministic int8 test data */
+void fill(int8_t *data, size_t n, uint32_t seed) {
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = int8_t(seed >> 16);
+  }
+}
+
+void check(bool ok, const std::string &what) {
+  if (!ok)
+    throw std::runtime_error(what);
+}
+
+/*
+ * One pass of the conv core, as the driver programs it. in, filters, bias
+ * and out are relocated to the pass's offsets; in_size is what is left of
+ * the input surface from there. Taps land on PADDING rows of padding above
+ * and below the IACT_H rows, and nowhere else.
+ */
+void core_pass(const exsl_write_config_args &c, uint32_t atom,
+               const int8_t *in, uint64_t in_size, const int8_t *filters,
+               const int32_t *bias, int8_t *out) {
+  uint32_t kw = c.FILT_W ? c.FILT_W : c.FILT_H, sets = c.CHANNEL_SETS;
+  uint32_t stride_x = c.strideCX ? c.strideCX : c.stride;
+  uint32_t ox0 = c.tile_width_offset, oy0 = c.tile_height_offset / c.OACT_W;
+  uint32_t filter_count = c.flMaxValue / c.FILT_SIZE;
+  uint32_t set_bytes = c.FILT_SIZE / sets;
+  int64_t y_min = INT64_MAX, y_max = -1, x_min = INT64_MAX, x_max = -1;
+
+  check(oy0 + c.tile_height <= c.OACT_H && ox0 + c.tile_width <= c.OACT_W,
+        "tile outside the output");
+
+  for (uint32_t f = 0; f < filter_count; f++) {
+    const int8_t *filter = filters + uint64_t(f) * c.FILT_SIZE;
+
+    for (uint32_t oy = oy0; oy < oy0 + c.tile_height; oy++) {
+      for (uint32_t ox = ox0; ox < ox0 + c.tile_width; ox++) {
+        int64_t acc = c.enableBias ? bias[f] : 0;
+
+        for (uint32_t cs = 0; cs < sets; cs++) {
+          for (uint32_t ky = 0; ky < c.FILT_H; ky++) {
+            int64_t y = int64_t(oy) * c.strideCY + ky - c.PADDING;
+            check(y < int64_t(c.IACT_H) + c.PADDING, "tap below the padding");
+            if (y < 0 || y >= c.IACT_H)
+              continue;
+
+            for (uint32_t kx = 0; kx < kw; kx++) {
+              int64_t x = int64_t(ox) * stride_x + kx - c.paddingW;
+              if (x < 0 || x >= c.IACT_W)
+                continue;
+
+              uint64_t at = y * c.LINE_STRIDE * sets + cs * c.SURF_STRIDE +
+                            x * atom;
+              check(at + atom <= in_size, "read past the input surface");
+              y_min = std::min(y_min, y);
+              y_max = std::max(y_max, y);
+              x_min = std::min(x_min, x);
+              x_max = std::max(x_max, x);
+              for (uint32_t a = 0; a < atom; a++)
+                acc += in[at + a] *
+                       filter[cs * set_bytes + (ky * kw + kx) * atom + a];
+            }
+          }
+        }
+
+        acc *= c.scalingFactor1;
+        if (c.quant_shifter)
+          acc = (acc + (int64_t(1) << (c.quant_shifter - 1))) >>
+                c.quant_shifter;
+        if (c.enableRelu)
+          acc = std::max<int64_t>(acc, 0);
+        acc += int32_t(c.quant_zero_point);
+        out[(uint64_t(oy) * c.TOTAL_FIL_SETS + f / atom) * c.OACT_W * atom +
+            ox * atom + f % atom] =
+            int8_t(std::min<int64_t>(std::max<int64_t>(acc, -128), 127));
+      }
+    }
+  }
+
+  /* The rows and columns read have to fit the window the core loads */
+  if (y_max >= 0) {
+    check(uint64_t(y_max - y_min + 1) <= c.IACT_MAX_STRIPE,
+          "window taller than IACT_MAX_STRIPE");
+    check(uint64_t(y_max - y_min + 1) * (x_max - x_min + 1) * sets * atom <=
+              c.IACT_MAX_VALUE,
+          "window larger than IACT_MAX_VALUE");
+  }
+}
+
+void run_case(const Case &test) {
+  const exsl::Target &target = test.target;
+  uint32_t atom = target.channel_atom;
+  exsl_conv_shape conv = exsl::lower_conv(test.conv);
+  uint32_t out_h = exsl::conv_out_h(conv), out_w = exsl::conv_out_w(conv);
+  const char *why = exsl::conv_unsupported(target, test.conv);
+
+  if (why)
+    throw std::runtime_error(why);
+
+  std::vector<int8_t> nchw(size_t(conv.channels) * conv.height * conv.width);
+  std::vector<int8_t> fchw(size_t(conv.filters) * conv.channels *
+                           test.conv.kernel_h * test.conv.kernel_w);
+  std::vector<int32_t> bias(conv.filters);
+  std::vector<int8_t> input(
+      exsl::surface_size(target, conv.channels, conv.height, conv.width));
+  uint64_t out_size = exsl::surface_size(target, conv.filters, out_h, out_w);
+  std::vector<int8_t> expected(out_size), got(out_size);
+
+  fill(nchw.data(), nchw.size(), 1);
+  fill(fchw.data(), fchw.size(), 2);
+  for (uint32_t f = 0; f < conv.filters; f++)
+    bias[f] = int32_t(f * 37) - 300;
+  std::vector<int8_t> filters =
+      exsl::pack_filters(target, test.conv, fchw.data());
+
+  exsl_exec_cpu_op op = {};
+  op.shape = conv;
+  op.op = EXSL_EXEC_CPU_TO_SURFACE;
+  uint8_t *to_surface[EXSL_EXEC_CPU_NUM_SLOTS] = {
+      reinterpret_cast<uint8_t *>(nchw.data()), nullptr, nullptr,
+      reinterpret_cast<uint8_t *>(input.data())};
+  exsl::cpu_run(op, atom, to_surface);
+
+  op.op = EXSL_EXEC_CPU_CONV;
+  uint8_t *operands[EXSL_EXEC_CPU_NUM_SLOTS] = {
+      reinterpret_cast<uint8_t *>(input.data()),
+      reinterpret_cast<uint8_t *>(filters.data()),
+      reinterpret_cast<uint8_t *>(bias.data()),
+      reinterpret_cast<uint8_t *>(expected.data())};
+  exsl::cpu_run(op, atom, operands);
+
+  /* Unwritten outputs show up as a mismatch rather than as zeroes */
+  std::fill(got.begin(), got.end(), int8_t(0x5a));
+  exsl::ConvPlan plan = exsl::plan_conv(target, test.conv);
+  for (const auto &pass : plan.passes) {
+    check(pass.input_offset < input.size(), "pass input outside the input");
+    core_pass(pass.config, atom, input.data() + pass.input_offset,
+              input.size() - pass.input_offset,
+              filters.data() + pass.filter_offset,
+              bias.data() + pass.bias_offset / 4,
+              got.data() + pass.output_offset);
+  }
+
+  /* Only the channels of the output are compared, not the atom padding */
+  for (uint32_t y = 0; y < out_h; y++)
+    for (uint32_t f = 0; f < conv.filters; f++)
+      for (uint32_t x = 0; x < out_w; x++) {
+        uint64_t at =
+            ((uint64_t(y) * ((conv.filters + atom - 1) / atom) + f / atom) *
+                 out_w +
+             x) *
+                atom +
+            f % atom;
+        if (got[at] != expected[at])
+          throw std::runtime_error(
+              "output " + std::to_string(f) + "," + std::to_string(y) + "," +
+              std::to_string(x) + " is " + std::to_string(got[at]) +
+              ", expected " + std::to_string(expected[at]));
+      }
+
+  printf("ok   %-28s %3zu passes of %ux%u\n", test.name, plan.passes.size(),
+         plan.tile_h, plan.tile_w);
+}
+
+/*
+ * A 1080p layer plans more passes than one job takes. There is no device
+ * here, so the jobs point at null descriptors and BOs; only their split is
+ * checked.
+ */
+void run_job_split() {
+  exsl::Target target;
+  exsl_conv_shape conv = shape(32, 1080, 1920, 32, 3, 3, 1, 1, 1, 1, 1, 1);
+  exsl::ConvPlan plan = exsl::plan_conv(target, conv);
+  std::vector<exsl::Descriptor> descs(plan.passes.size());
+  exsl::Bo input, filters, bias, output;
+  size_t layers = 0;
+
+  check(plan.passes.size() > EXSL_MAX_JOB_LAYERS,
+        "plan fits one job, the case tests nothing");
+
+  std::vector<exsl::Job> jobs =
+      exsl::conv_jobs(plan, descs, input, filters, &bias, output);
+  for (const auto &job : jobs) {
+    check(job.layer_count() > 0 && job.layer_count() <= EXSL_MAX_JOB_LAYERS,
+          "job outside the layer limit");
+    check(job.bo_count() <= EXSL_MAX_JOB_HANDLES, "job over the BO limit");
+    layers += job.layer_count();
+  }
+  check(layers == plan.passes.size(), "passes lost between jobs");
+
+  printf("ok   %-28s %3zu passes in %zu jobs\n", "1080p over one job",
+         plan.passes.size(), jobs.size());
+}
+
+} // namespace
+
+int main() {
+  const Case cases[] = {
+      {"3x3", shape(5, 9, 11, 12, 3, 3, 1, 1, 1, 1, 1, 1),
+       small_rams(512, 512)},
+      {"3x3 tiled", shape(5, 9, 11, 12, 3, 3, 1, 1, 1, 1, 1, 1),
+       small_rams(48, 192)},
+      /* Same padded: pad 2, dilation 2 and a 3-row kernel */
+      {"3x3 dilated 2 pad 2", shape(4, 7, 8, 9, 3, 3, 1, 1, 2, 2, 2, 2),
+       small_rams(512, 512)},
+      {"3x3 dilated 2 pad 2 tiled", shape(4, 7, 8, 9, 3, 3, 1, 1, 2, 2, 2, 2),
+       small_rams(40, 256)},
+      {"3x2 dilated 3x2 stride 2", shape(6, 13, 10, 10, 3, 2, 2, 1, 3, 1, 3, 2),
+       small_rams(512, 512)},
+      {"2x3 dilated 4 stride 3", shape(3, 17, 9, 7, 2, 3, 3, 2, 3, 1, 4, 1),
+       small_rams(64, 512)},
+      {"5x1 dilated 2 stride 2", shape(8, 20, 6, 17, 5, 1, 2, 1, 4, 0, 2, 1),
+       small_rams(96, 96)},
+      /* Two channel sets, bottom rows of each phase with a cut FILT_H */
+      {"3x3 dilated 3 pad 4 sets 2",
+       shape(12, 13, 9, 10, 3, 3, 1, 1, 4, 1, 3, 1), small_rams(512, 512)},
+  };
+  int failed = 0;
+
+  for (const auto &test : cases) {
+    try {
+      run_case(test);
+    } catch (const std::exception &e) {
+      printf("FAIL %-28s %s\n", test.name, e.what());
+      failed++;
+    }
+  }
+
+  try {
+    run_job_split();
+  } catch (const std::exception &e) {
+    printf("FAIL %-28s %s\n", "1080p over one job", e.what());
+    failed++;
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * exslerate-run - run a compiled ExSLerate executable
+ *
+ * Takes one file per input and output binding, in binding order: inputs
+ * are read from their file, outputs written to theirs after the last run.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include "exslerate.hpp"
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-d node] [-n iters] executable file...\n"
+          "One file per input and output of the executable, in order.\n",
+          prog);
+  exit(1);
+}
+
+static void load_input(exsl::Bo &bo, const char *path, uint64_t size) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file.read(static_cast<char *>(bo.map()), size))
+    throw std::runtime_error(std::string(path) + ": short input");
+}
+
+static void save_output(exsl::Bo &bo, const char *path, uint64_t size) {
+  std::ofstream file(path, std::ios::binary);
+
+  bo.cpu_prep(EXSL_CPU_SYNC_READ);
+  file.write(static_cast<const char *>(bo.map()), size);
+  bo.cpu_fini(EXSL_CPU_SYNC_READ);
+  if (!file)
+    throw std::runtime_error(std::string(path) + ": write failed");
+}
+
+int main(int argc, char **argv) {
+  const char *node = "/dev/dri/renderD128";
+  int iters = 1, opt;
+
+  while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+    switch (opt) {
+    case 'd':
+      node = optarg;
+      break;
+    case 'n':
+      iters = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc || iters < 1)
+    usage(argv[0]);
+
+  try {
+    exsl::Device dev(node);
+    exsl::Executable exe = exsl::Executable::load(dev, argv[optind++]);
+    const auto &io = exe.io();
+    std::vector<exsl::BoSpec> specs;
+    std::vector<exsl::Bo *> args;
+    uint64_t busy_ns = 0;
+
+    if ((size_t)(argc - optind) != io.size()) {
+      fprintf(stderr, "Executable takes %zu files\n", io.size());
+      return 1;
+    }
+
+    for (const auto &binding : io)
+      specs.push_back({binding.size});
+    std::vector<exsl::Bo> bos = dev.create_bos(specs);
+
+    for (size_t i = 0; i < io.size(); i++) {
+      if (io[i].kind == EXSL_EXEC_BINDING_INPUT)
+        load_input(bos[i], argv[optind + i], io[i].size);
+      args.push_back(&bos[i]);
+    }
+
+    exsl::Context ctx = dev.create_context();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; i++) {
+      exsl::Fence fence = exe.dispatch(ctx, args);
+      /* Covers every device job of the run, even before a CPU layer */
+      fence.wait();
+      busy_ns += fence.busy_ns();
+    }
+    std::chrono::duration<double, std::milli> wall =
+        std::chrono::steady_clock::now() - start;
+
+    printf("%d runs: %.3f ms wall, %.3f ms device busy, per run\n", iters,
+           wall.count() / iters, busy_ns / 1e6 / iters);
+
+    for (size_t i = 0; i < io.size(); i++)
+      if (io[i].kind == EXSL_EXEC_BINDING_OUTPUT)
+        save_output(bos[i], argv[optind + i], io[i].size);
+  } catch (const std::exception &e) {
+    fprintf(stderr, "exslerate-run: %s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
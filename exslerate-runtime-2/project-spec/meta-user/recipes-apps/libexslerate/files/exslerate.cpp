@@ -0,0 +1,449 @@
+/* exslerate.cpp - libexslerate, C++ runtime over the ExSLerate DRM ioctls */
+#include "exslerate.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+namespace exsl {
+namespace detail {
+
+struct DeviceImpl {
+  int fd = -1;
+  long page_size = sysconf(_SC_PAGESIZE);
+  std::mutex lock; /* Protects cache */
+  std::unordered_map<uint32_t, BoInfo> cache;
+
+  DeviceImpl() = default;
+  DeviceImpl(const DeviceImpl &) = delete;
+  DeviceImpl &operator=(const DeviceImpl &) = delete;
+
+  /* Runs wherever the impl goes, so a moved-over Device closes its fd too */
+  ~DeviceImpl() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  /* ioctl, restarted when a signal interrupts it */
+  int ioctl(unsigned long request, void *arg) {
+    int ret;
+
+    do
+      ret = ::ioctl(fd, request, arg);
+    while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+    return ret == -1 ? -errno : 0;
+  }
+
+  void check(unsigned long request, void *arg, const char *what) {
+    int ret = ioctl(request, arg);
+
+    if (ret)
+      throw Error(-ret, what);
+  }
+
+  void cache_put(uint32_t handle, const BoInfo &info) {
+    std::lock_guard<std::mutex> guard(lock);
+    cache[handle] = info;
+  }
+
+  void cache_drop(uint32_t handle) {
+    std::lock_guard<std::mutex> guard(lock);
+    cache.erase(handle);
+  }
+};
+
+} // namespace detail
+
+/* Bo */
+
+Bo::Bo(detail::DeviceImpl *dev, uint32_t handle, const BoInfo &info)
+    : dev_(dev), handle_(handle), info_(info) {
+  dev_->cache_put(handle_, info_);
+}
+
+Bo::Bo(Bo &&other) noexcept { *this = std::move(other); }
+
+Bo &Bo::operator=(Bo &&other) noexcept {
+  if (this != &other) {
+    reset();
+    dev_ = std::exchange(other.dev_, nullptr);
+    handle_ = std::exchange(other.handle_, 0);
+    info_ = other.info_;
+    map_ = std::exchange(other.map_, nullptr);
+    map_size_ = std::exchange(other.map_size_, 0);
+  }
+  return *this;
+}
+
+Bo::~Bo() { reset(); }
+
+void Bo::reset() noexcept {
+  if (!handle_)
+    return;
+
+  if (map_)
+    munmap(map_, map_size_);
+  dev_->cache_drop(handle_);
+
+  exsl_gem_destroy_args args = {};
+  args.handle = handle_;
+  dev_->ioctl(DRM_IOCTL_EXSL_GEM_DESTROY, &args);
+
+  handle_ = 0;
+  map_ = nullptr;
+}
+
+void *Bo::map() {
+  if (!map_) {
+    size_t mask = dev_->page_size - 1;
+    size_t size = (info_.offset + info_.size + mask) & ~mask;
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     dev_->fd, info_.map_offset);
+
+    if (ptr == MAP_FAILED)
+      throw Error(errno, "mmap");
+    map_ = ptr;
+    map_size_ = size;
+  }
+  return static_cast<char *>(map_) + info_.offset;
+}
+
+void Bo::cpu_prep(uint32_t flags, uint64_t offset, uint64_t size,
+                  uint32_t timeout_ms) {
+  exsl_cpu_sync_args args = {};
+
+  args.handle = handle_;
+  args.flags = flags;
+  args.offset = offset;
+  args.size = size;
+  args.timeout_ms = timeout_ms;
+  dev_->check(DRM_IOCTL_EXSL_CPU_PREP, &args, "CPU_PREP");
+}
+
+void Bo::cpu_fini(uint32_t flags, uint64_t offset, uint64_t size) {
+  exsl_cpu_sync_args args = {};
+
+  args.handle = handle_;
+  args.flags = flags;
+  args.offset = offset;
+  args.size = size;
+  dev_->check(DRM_IOCTL_EXSL_CPU_FINI, &args, "CPU_FINI");
+}
+
+/* Descriptor */
+
+Descriptor::Descriptor(Descriptor &&other) noexcept {
+  *this = std::move(other);
+}
+
+Descriptor &Descriptor::operator=(Descriptor &&other) noexcept {
+  if (this != &other) {
+    reset();
+    dev_ = std::exchange(other.dev_, nullptr);
+    handle_ = std::exchange(other.handle_, 0);
+    core_type_ = other.core_type_;
+  }
+  return *this;
+}
+
+Descriptor::~Descriptor() { reset(); }
+
+void Descriptor::reset() noexcept {
+  if (!handle_)
+    return;
+
+  exsl_destroy_desc_args args = {};
+  args.handle = handle_;
+  dev_->ioctl(DRM_IOCTL_EXSL_DESTROY_DESC, &args);
+  handle_ = 0;
+}
+
+/* Job */
+
+uint32_t Job::add_layer(const Descriptor &desc) {
+  layers_.push_back(desc.handle());
+  return layers_.size() - 1;
+}
+
+uint32_t Job::add_bo(const Bo &bo) {
+  for (uint32_t i = 0; i < bos_.size(); i++)
+    if (bos_[i] == bo.handle())
+      return i;
+
+  bos_.push_back(bo.handle());
+  return bos_.size() - 1;
+}
+
+void Job::reloc(uint32_t layer, uint32_t slot, const Bo &bo,
+                uint64_t offset) {
+  exsl_reloc reloc = {};
+
+  reloc.layer = layer;
+  reloc.slot = slot;
+  reloc.bo_index = add_bo(bo);
+  reloc.offset = offset;
+  relocs_.push_back(reloc);
+}
+
+/* Fence */
+
+Fence::Fence(Fence &&other) noexcept { *this = std::move(other); }
+
+Fence::Fence(std::vector<Fence> &&jobs) : jobs_(std::move(jobs)) {
+  if (!jobs_.empty()) {
+    hwctx_ = jobs_.back().hwctx_;
+    seq_ = jobs_.back().seq_;
+  }
+}
+
+Fence &Fence::operator=(Fence &&other) noexcept {
+  dev_ = std::exchange(other.dev_, nullptr);
+  hwctx_ = other.hwctx_;
+  seq_ = other.seq_;
+  signaled_ = other.signaled_;
+  busy_ns_ = other.busy_ns_;
+  idle_gap_ns_ = other.idle_gap_ns_;
+  jobs_ = std::move(other.jobs_);
+  return *this;
+}
+
+bool Fence::wait(uint32_t timeout_ms) {
+  exsl_wait_args args = {};
+  int ret;
+
+  if (signaled_)
+    return true;
+
+  if (!jobs_.empty()) {
+    busy_ns_ = idle_gap_ns_ = 0;
+    for (auto &job : jobs_) {
+      if (!job.wait(timeout_ms))
+        return false;
+      busy_ns_ += job.busy_ns_;
+      idle_gap_ns_ += job.idle_gap_ns_;
+    }
+    signaled_ = true;
+    return true;
+  }
+
+  /* A default fence stands for work that already completed */
+  if (!dev_)
+    return true;
+
+  args.hwctx = hwctx_;
+  args.timeout_ms = timeout_ms;
+  args.seq = seq_;
+  ret = dev_->ioctl(DRM_IOCTL_EXSL_WAIT, &args);
+  if (ret == -ETIME)
+    return false;
+  if (ret)
+    throw Error(-ret, "WAIT");
+
+  signaled_ = true;
+  busy_ns_ = args.busy_ns;
+  idle_gap_ns_ = args.idle_gap_ns;
+  return true;
+}
+
+/* Context */
+
+Context::Context(Context &&other) noexcept { *this = std::move(other); }
+
+Context &Context::operator=(Context &&other) noexcept {
+  if (this != &other) {
+    reset();
+    dev_ = std::exchange(other.dev_, nullptr);
+    handle_ = std::exchange(other.handle_, 0);
+  }
+  return *this;
+}
+
+Context::~Context() { reset(); }
+
+void Context::reset() noexcept {
+  if (!handle_)
+    return;
+
+  exsl_hwctx_args args = {};
+  args.handle = handle_;
+  dev_->ioctl(DRM_IOCTL_EXSL_DESTROY_HWCTX, &args);
+  handle_ = 0;
+}
+
+void Context::configure(const exsl_write_config_args &config) {
+  exsl_config_hwctx_args args = {};
+
+  args.handle = handle_;
+  args.config = reinterpret_cast<uintptr_t>(&config);
+  dev_->check(DRM_IOCTL_EXSL_CONFIG_HWCTX, &args, "CONFIG_HWCTX");
+}
+
+Fence Context::submit_args(exsl_submit_args &args) {
+  args.hwctx = handle_;
+  args.type = EXSL_CMD_SUBMIT_EXEC_BUF;
+  dev_->check(DRM_IOCTL_EXSL_SUBMIT, &args, "SUBMIT");
+  return Fence(dev_, handle_, args.seq);
+}
+
+Fence Context::submit(const Job &job) {
+  exsl_submit_relocs relocs = {};
+  exsl_submit_args args = {};
+
+  args.cmd_handles = reinterpret_cast<uintptr_t>(job.bos_.data());
+  args.cmd_count = job.bos_.size();
+  args.args = reinterpret_cast<uintptr_t>(job.layers_.data());
+  args.arg_count = job.layers_.size();
+
+  if (!job.relocs_.empty()) {
+    relocs.relocs = reinterpret_cast<uintptr_t>(job.relocs_.data());
+    relocs.count = job.relocs_.size();
+    args.ext = reinterpret_cast<uintptr_t>(&relocs);
+    args.ext_flags = EXSL_SUBMIT_EXT_RELOCS;
+  }
+
+  return submit_args(args);
+}
+
+Fence Context::submit() {
+  exsl_submit_args args = {};
+
+  return submit_args(args);
+}
+
+/* Device */
+
+Device::Device(const std::string &node)
+    : impl_(std::make_unique<detail::DeviceImpl>()) {
+  impl_->fd = open(node.c_str(), O_RDWR | O_CLOEXEC);
+  if (impl_->fd < 0)
+    throw Error(errno, node.c_str());
+}
+
+Device::Device(Device &&) noexcept = default;
+Device &Device::operator=(Device &&) noexcept = default;
+
+Device::~Device() = default;
+
+int Device::fd() const { return impl_->fd; }
+
+Bo Device::create_bo(uint64_t size, uint64_t type, uint64_t flags) {
+  exsl_drm_create_bo create = {};
+  exsl_gem_map_offset_args map = {};
+
+  create.flags = flags;
+  create.size = size;
+  create.type = type;
+  impl_->check(DRM_IOCTL_EXSL_CREATE_BO, &create, "CREATE_BO");
+
+  /* Owned from here, so a failing GEM_MMAP still releases the handle */
+  Bo bo(impl_.get(), create.handle, BoInfo{create.size});
+  map.handle = create.handle;
+  impl_->check(DRM_IOCTL_EXSL_GEM_MMAP, &map, "GEM_MMAP");
+
+  bo.info_.map_offset = map.map_offset;
+  bo.info_.dev_addr = map.dev_addr;
+  bo.info_.offset = map.offset;
+  impl_->cache_put(bo.handle_, bo.info_);
+  return bo;
+}
+
+std::vector<Bo> Device::create_bos(const std::vector<BoSpec> &specs) {
+  std::vector<exsl_bo_batch_entry> entries(specs.size());
+  exsl_create_bos_args args = {};
+  std::vector<Bo> bos;
+
+  for (size_t i = 0; i < specs.size(); i++) {
+    entries[i].flags = specs[i].flags;
+    entries[i].size = specs[i].size;
+    entries[i].type = specs[i].type;
+  }
+
+  args.bos = reinterpret_cast<uintptr_t>(entries.data());
+  args.count = entries.size();
+  impl_->check(DRM_IOCTL_EXSL_CREATE_BOS, &args, "CREATE_BOS");
+
+  bos.reserve(entries.size());
+  for (const auto &e : entries)
+    bos.push_back(Bo(impl_.get(), e.handle,
+                     BoInfo{e.size, e.map_offset, e.dev_addr, e.offset}));
+  return bos;
+}
+
+void Device::destroy_bos(std::vector<Bo> &bos) {
+  std::vector<uint32_t> handles;
+  exsl_destroy_bos_args args = {};
+
+  for (auto &bo : bos) {
+    if (!bo)
+      continue;
+    if (bo.map_)
+      munmap(bo.map_, bo.map_size_);
+    impl_->cache_drop(bo.handle_);
+    handles.push_back(bo.handle_);
+    bo.handle_ = 0;
+    bo.map_ = nullptr;
+  }
+  bos.clear();
+
+  if (handles.empty())
+    return;
+
+  args.handles = reinterpret_cast<uintptr_t>(handles.data());
+  args.count = handles.size();
+  impl_->check(DRM_IOCTL_EXSL_DESTROY_BOS, &args, "DESTROY_BOS");
+}
+
+BoInfo Device::lookup(uint32_t handle) {
+  exsl_gem_map_offset_args map = {};
+  BoInfo info;
+
+  {
+    std::lock_guard<std::mutex> guard(impl_->lock);
+    auto it = impl_->cache.find(handle);
+    if (it != impl_->cache.end())
+      return it->second;
+  }
+
+  map.handle = handle;
+  impl_->check(DRM_IOCTL_EXSL_GEM_MMAP, &map, "GEM_MMAP");
+
+  /* GEM_MMAP does not return the size; BOs created here have it cached */
+  info.map_offset = map.map_offset;
+  info.dev_addr = map.dev_addr;
+  info.offset = map.offset;
+  impl_->cache_put(handle, info);
+  return info;
+}
+
+Descriptor Device::create_desc(const exsl_write_config_args &config) {
+  exsl_create_desc_args args = {};
+
+  args.config = reinterpret_cast<uintptr_t>(&config);
+  args.core_type = EXSL_CONV_CORE;
+  impl_->check(DRM_IOCTL_EXSL_CREATE_DESC, &args, "CREATE_DESC");
+  return Descriptor(impl_.get(), args.handle, EXSL_CONV_CORE);
+}
+
+Context Device::create_context() {
+  exsl_hwctx_args args = {};
+
+  impl_->check(DRM_IOCTL_EXSL_CREATE_HWCTX, &args, "CREATE_HWCTX");
+  return Context(impl_.get(), args.handle);
+}
+
+Context Device::default_context() { return Context(impl_.get(), 0); }
+
+exsl_engine_stats_args Device::engine_stats(uint32_t core_type) {
+  exsl_engine_stats_args args = {};
+
+  args.core_type = core_type;
+  impl_->check(DRM_IOCTL_EXSL_ENGINE_STATS, &args, "ENGINE_STATS");
+  return args;
+}
+
+} // namespace exsl
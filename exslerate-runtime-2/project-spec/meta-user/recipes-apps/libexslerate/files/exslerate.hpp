@@ -0,0 +1,304 @@
+/*
+ * libexslerate - C++ runtime over the ExSLerate DRM ioctls
+ *
+ * Everything created from a Device (BOs, descriptors, contexts, fences)
+ * refers back to it and must not outlive it. All types are move-only and
+ * release their kernel object on destruction. Failing ioctls throw
+ * exsl::Error carrying the errno.
+ */
+#ifndef _EXSLERATE_HPP_
+#define _EXSLERATE_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "exslerate_executable.h"
+#include "exslerate_ioctl.h"
+
+namespace exsl {
+
+class Device;
+class Bo;
+class Job;
+
+namespace detail {
+struct DeviceImpl;
+}
+
+class Error : public std::system_error {
+public:
+  Error(int err, const char *what)
+      : std::system_error(err, std::generic_category(), what) {}
+};
+
+/* What GEM_MMAP returns for a BO, kept so it is only asked once */
+struct BoInfo {
+  uint64_t size = 0;
+  uint64_t map_offset = 0; /* mmap offset on the device fd */
+  uint64_t dev_addr = 0;   /* 0 for evictable BOs, use relocations */
+  uint32_t offset = 0;     /* Offset of the BO in its first mapped page */
+};
+
+/* One BO of a Device::create_bos batch */
+struct BoSpec {
+  uint64_t size;
+  uint64_t type = EXSL_BO_SHARE;
+  uint64_t flags = 0; /* EXSL_BO_FLAG_* */
+};
+
+class Bo {
+public:
+  Bo() = default;
+  Bo(Bo &&other) noexcept;
+  Bo &operator=(Bo &&other) noexcept;
+  Bo(const Bo &) = delete;
+  Bo &operator=(const Bo &) = delete;
+  ~Bo();
+
+  explicit operator bool() const { return handle_ != 0; }
+  uint32_t handle() const { return handle_; }
+  const BoInfo &info() const { return info_; }
+  uint64_t size() const { return info_.size; }
+  uint64_t dev_addr() const { return info_.dev_addr; }
+
+  /* CPU address of the BO, mmapped on first use */
+  void *map();
+
+  /* Bracket CPU access to a range, see struct exsl_cpu_sync_args */
+  void cpu_prep(uint32_t flags, uint64_t offset = 0, uint64_t size = 0,
+                uint32_t timeout_ms = 0);
+  void cpu_fini(uint32_t flags, uint64_t offset = 0, uint64_t size = 0);
+
+private:
+  friend class Device;
+  Bo(detail::DeviceImpl *dev, uint32_t handle, const BoInfo &info);
+  void reset() noexcept;
+
+  detail::DeviceImpl *dev_ = nullptr;
+  uint32_t handle_ = 0;
+  BoInfo info_;
+  void *map_ = nullptr;
+  size_t map_size_ = 0;
+};
+
+/* A layer config packed by the driver once, reused by every submit */
+class Descriptor {
+public:
+  Descriptor() = default;
+  Descriptor(Descriptor &&other) noexcept;
+  Descriptor &operator=(Descriptor &&other) noexcept;
+  Descriptor(const Descriptor &) = delete;
+  Descriptor &operator=(const Descriptor &) = delete;
+  ~Descriptor();
+
+  explicit operator bool() const { return handle_ != 0; }
+  uint32_t handle() const { return handle_; }
+  uint32_t core_type() const { return core_type_; }
+
+private:
+  friend class Device;
+  Descriptor(detail::DeviceImpl *dev, uint32_t handle, uint32_t core_type)
+      : dev_(dev), handle_(handle), core_type_(core_type) {}
+  void reset() noexcept;
+
+  detail::DeviceImpl *dev_ = nullptr;
+  uint32_t handle_ = 0;
+  uint32_t core_type_ = EXSL_CONV_CORE;
+};
+
+/*
+ * The layers of one EXEC_BUF submit and the BOs they use. The Job only
+ * records handles; the BOs and descriptors must live until it is submitted.
+ */
+class Job {
+public:
+  Job() = default;
+  Job(Job &&) noexcept = default;
+  Job &operator=(Job &&) noexcept = default;
+  Job(const Job &) = delete;
+  Job &operator=(const Job &) = delete;
+
+  /* Returns the index of the layer in the job */
+  uint32_t add_layer(const Descriptor &desc);
+  /* Adds the BO once and returns its index in cmd_handles */
+  uint32_t add_bo(const Bo &bo);
+  /* Point an address slot of a layer at bo + offset, adding the BO */
+  void reloc(uint32_t layer, uint32_t slot, const Bo &bo,
+             uint64_t offset = 0);
+
+  /* Against EXSL_MAX_JOB_LAYERS and EXSL_MAX_JOB_HANDLES */
+  size_t layer_count() const { return layers_.size(); }
+  size_t bo_count() const { return bos_.size(); }
+
+private:
+  friend class Context;
+
+  std::vector<uint32_t> bos_;
+  std::vector<uint32_t> layers_;
+  std::vector<exsl_reloc> relocs_;
+};
+
+/* Completion of a submitted job */
+class Fence {
+public:
+  Fence() = default;
+  Fence(Fence &&other) noexcept;
+  Fence &operator=(Fence &&other) noexcept;
+  Fence(const Fence &) = delete;
+  Fence &operator=(const Fence &) = delete;
+
+  /*
+   * The completion of several jobs, e.g. all those of a dispatch. It waits
+   * for each in turn and sums their busy_ns/idle_gap_ns.
+   */
+  explicit Fence(std::vector<Fence> &&jobs);
+
+  explicit operator bool() const { return dev_ != nullptr || !jobs_.empty(); }
+  uint64_t seq() const { return seq_; }
+
+  /*
+   * Block until the job is done, 0 waiting indefinitely. Returns false on
+   * timeout and throws if the job failed; busy_ns/idle_gap_ns are filled
+   * in once it returns true.
+   */
+  bool wait(uint32_t timeout_ms = 0);
+  bool signaled() const { return signaled_; }
+  uint64_t busy_ns() const { return busy_ns_; }
+  uint64_t idle_gap_ns() const { return idle_gap_ns_; }
+
+private:
+  friend class Context;
+  Fence(detail::DeviceImpl *dev, uint32_t hwctx, uint64_t seq)
+      : dev_(dev), hwctx_(hwctx), seq_(seq) {}
+
+  detail::DeviceImpl *dev_ = nullptr;
+  uint32_t hwctx_ = 0;
+  uint64_t seq_ = 0;
+  bool signaled_ = false;
+  uint64_t busy_ns_ = 0;
+  uint64_t idle_gap_ns_ = 0;
+  std::vector<Fence> jobs_; /* Set for a fence of several jobs */
+};
+
+/* A hardware context: an ordered queue of jobs */
+class Context {
+public:
+  Context() = default;
+  Context(Context &&other) noexcept;
+  Context &operator=(Context &&other) noexcept;
+  Context(const Context &) = delete;
+  Context &operator=(const Context &) = delete;
+  ~Context();
+
+  uint32_t handle() const { return handle_; }
+
+  /* Set the config run by submits without layers */
+  void configure(const exsl_write_config_args &config);
+
+  /* Queue a job and return without waiting for it */
+  Fence submit(const Job &job);
+  /* Queue a run of the context's current config */
+  Fence submit();
+
+private:
+  friend class Device;
+  Context(detail::DeviceImpl *dev, uint32_t handle)
+      : dev_(dev), handle_(handle) {}
+  void reset() noexcept;
+  Fence submit_args(exsl_submit_args &args);
+
+  detail::DeviceImpl *dev_ = nullptr;
+  uint32_t handle_ = 0; /* 0 is the file's default context, never destroyed */
+};
+
+class Device {
+public:
+  explicit Device(const std::string &node = "/dev/dri/renderD128");
+  Device(Device &&) noexcept;
+  Device &operator=(Device &&) noexcept;
+  Device(const Device &) = delete;
+  Device &operator=(const Device &) = delete;
+  ~Device();
+
+  int fd() const;
+
+  Bo create_bo(uint64_t size, uint64_t type = EXSL_BO_SHARE,
+               uint64_t flags = 0);
+  /* Create and map all BOs with one CREATE_BOS call, or none */
+  std::vector<Bo> create_bos(const std::vector<BoSpec> &specs);
+  /* Release BOs with one DESTROY_BOS call */
+  void destroy_bos(std::vector<Bo> &bos);
+
+  /*
+   * Map info of any handle of this file, e.g. one imported elsewhere.
+   * Only the first lookup of a handle issues GEM_MMAP.
+   */
+  BoInfo lookup(uint32_t handle);
+
+  Descriptor create_desc(const exsl_write_config_args &config);
+
+  Context create_context();
+  /* The file's context 0, used by WRITE_CONFIG */
+  Context default_context();
+
+  exsl_engine_stats_args engine_stats(uint32_t core_type);
+
+private:
+  std::unique_ptr<detail::DeviceImpl> impl_;
+};
+
+/*
+ * A compiled model (exslerate_executable.h) loaded onto a device: its
+ * descriptors are packed, constants uploaded and scratch buffers allocated
+ * once, so a dispatch only builds and queues the jobs.
+ */
+class Executable {
+public:
+  Executable(Device &dev, const std::vector<uint8_t> &image);
+  static Executable load(Device &dev, const std::string &path);
+
+  Executable(Executable &&) noexcept = default;
+  Executable &operator=(Executable &&) noexcept = default;
+  Executable(const Executable &) = delete;
+  Executable &operator=(const Executable &) = delete;
+
+  /* Input and output bindings, in the order dispatch() takes them */
+  const std::vector<exsl_exec_binding> &io() const { return io_; }
+
+  /*
+   * Run the model on a context with one BO per io() binding. Layers run
+   * in order, one job per run of layers on the same core (split at the job
+   * limits); the returned fence covers all of them. CPU layers run inline
+   * after waiting for the jobs before them, so a model with any blocks
+   * until they ran, and throws if one of those jobs failed.
+   */
+  Fence dispatch(Context &ctx, const std::vector<Bo *> &io);
+
+private:
+  struct Layer {
+    uint32_t core_type;
+    Descriptor desc;     /* Device layers */
+    exsl_exec_cpu_op op; /* EXSL_EXEC_CPU_CORE */
+  };
+
+  using RelocIter = std::vector<exsl_reloc>::const_iterator;
+
+  Bo &binding_bo(uint32_t binding, const std::vector<Bo *> &io);
+  void run_cpu(const Layer &layer, RelocIter begin, RelocIter end,
+               const std::vector<Bo *> &io);
+
+  uint32_t channel_atom_ = 0;
+  std::vector<exsl_exec_binding> bindings_;
+  std::vector<exsl_exec_binding> io_;
+  std::vector<int32_t> io_index_; /* Binding to io() index, -1 if internal */
+  std::vector<Bo> bos_;           /* Binding to BO, empty for io() */
+  std::vector<Layer> layers_;
+  std::vector<exsl_reloc> relocs_; /* Sorted by layer */
+};
+
+} // namespace exsl
+
+#endif /* _EXSLERATE_HPP_ */
@@ -0,0 +1,169 @@
+/* exslerate_cpu.cpp - Host kernels of the layers the device cannot run */
+#include "exslerate_layer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "exslerate.hpp"
+
+namespace exsl {
+namespace {
+
+/* Offset of an element in the surface layout */
+struct Surface {
+  uint32_t atom, sets, width;
+
+  size_t at(uint32_t c, uint32_t y, uint32_t x) const {
+    return ((size_t(y) * sets + c / atom) * width + x) * atom + c % atom;
+  }
+};
+
+Surface surface(uint32_t atom, uint32_t channels, uint32_t width) {
+  return {atom, (channels + atom - 1) / atom, width};
+}
+
+int8_t saturate(int64_t v) {
+  return std::min<int64_t>(std::max<int64_t>(v, -128), 127);
+}
+
+void to_surface(const exsl_conv_shape &s, uint32_t atom, const int8_t *src,
+                int8_t *dst) {
+  Surface out = surface(atom, s.channels, s.width);
+
+  std::memset(dst, 0, out.at(0, s.height, 0));
+  for (uint32_t c = 0; c < s.channels; c++)
+    for (uint32_t y = 0; y < s.height; y++)
+      for (uint32_t x = 0; x < s.width; x++)
+        dst[out.at(c, y, x)] = *src++;
+}
+
+void from_surface(const exsl_conv_shape &s, uint32_t atom, const int8_t *src,
+                  int8_t *dst) {
+  Surface in = surface(atom, s.channels, s.width);
+
+  for (uint32_t c = 0; c < s.channels; c++)
+    for (uint32_t y = 0; y < s.height; y++)
+      for (uint32_t x = 0; x < s.width; x++)
+        *dst++ = src[in.at(c, y, x)];
+}
+
+void conv(const exsl_conv_shape &s, uint32_t atom, const int8_t *src,
+          const int8_t *filters, const int32_t *bias, int8_t *dst) {
+  Surface in = surface(atom, s.channels, s.width);
+  uint32_t out_h = conv_out_h(s), out_w = conv_out_w(s);
+  Surface out = surface(atom, s.filters, out_w);
+  size_t filter_bytes = size_t(in.sets) * s.kernel_h * s.kernel_w * atom;
+
+  std::memset(dst, 0, out.at(0, out_h, 0));
+  for (uint32_t f = 0; f < s.filters; f++) {
+    const int8_t *filter = filters + f * filter_bytes;
+
+    for (uint32_t oy = 0; oy < out_h; oy++) {
+      for (uint32_t ox = 0; ox < out_w; ox++) {
+        int64_t acc = s.has_bias ? bias[f] : 0;
+
+        for (uint32_t c = 0; c < s.channels; c++) {
+          for (uint32_t ky = 0; ky < s.kernel_h; ky++) {
+            int64_t y = int64_t(oy) * s.stride_h + ky * s.dilation_h - s.pad_h;
+            if (y < 0 || y >= s.height)
+              continue;
+
+            for (uint32_t kx = 0; kx < s.kernel_w; kx++) {
+              int64_t x =
+                  int64_t(ox) * s.stride_w + kx * s.dilation_w - s.pad_w;
+              if (x < 0 || x >= s.width)
+                continue;
+
+              acc += src[in.at(c, y, x)] *
+                     filter[(((c / atom) * s.kernel_h + ky) * s.kernel_w +
+                             kx) * atom +
+                            c % atom];
+            }
+          }
+        }
+
+        acc *= s.scale;
+        if (s.shift)
+          acc = (acc + (int64_t(1) << (s.shift - 1))) >> s.shift;
+        if (s.relu)
+          acc = std::max<int64_t>(acc, 0);
+        dst[out.at(f, oy, ox)] = saturate(acc + s.zero_point);
+      }
+    }
+  }
+}
+
+} // namespace
+
+uint64_t cpu_operand_size(const exsl_exec_cpu_op &op, uint32_t channel_atom,
+                          uint32_t slot) {
+  const exsl_conv_shape &s = op.shape;
+  Target target;
+  uint64_t nchw = uint64_t(s.channels) * s.height * s.width;
+
+  target.channel_atom = channel_atom;
+  switch (op.op) {
+  case EXSL_EXEC_CPU_COPY:
+    return slot == EXSL_EXEC_CPU_SRC || slot == EXSL_EXEC_CPU_DST ? op.size
+                                                                  : 0;
+  case EXSL_EXEC_CPU_ADD:
+    return slot == EXSL_EXEC_CPU_BIAS ? 0 : op.size;
+  case EXSL_EXEC_CPU_TO_SURFACE:
+  case EXSL_EXEC_CPU_FROM_SURFACE:
+    if (slot != EXSL_EXEC_CPU_SRC && slot != EXSL_EXEC_CPU_DST)
+      return 0;
+    return (slot == EXSL_EXEC_CPU_SRC) == (op.op == EXSL_EXEC_CPU_TO_SURFACE)
+               ? nchw
+               : surface_size(target, s.channels, s.height, s.width);
+  case EXSL_EXEC_CPU_CONV:
+    switch (slot) {
+    case EXSL_EXEC_CPU_SRC:
+      return surface_size(target, s.channels, s.height, s.width);
+    case EXSL_EXEC_CPU_SRC1:
+      return filter_size(target, s);
+    case EXSL_EXEC_CPU_BIAS:
+      return s.has_bias ? uint64_t(s.filters) * 4 : 0;
+    default:
+      return surface_size(target, s.filters, conv_out_h(s), conv_out_w(s));
+    }
+  default:
+    return 0;
+  }
+}
+
+void cpu_run(const exsl_exec_cpu_op &op, uint32_t channel_atom,
+             uint8_t *const operands[EXSL_EXEC_CPU_NUM_SLOTS]) {
+  auto src = reinterpret_cast<const int8_t *>(operands[EXSL_EXEC_CPU_SRC]);
+  auto src1 = reinterpret_cast<const int8_t *>(operands[EXSL_EXEC_CPU_SRC1]);
+  auto bias = reinterpret_cast<const int32_t *>(operands[EXSL_EXEC_CPU_BIAS]);
+  auto dst = reinterpret_cast<int8_t *>(operands[EXSL_EXEC_CPU_DST]);
+
+  if (!src || !dst || (op.op == EXSL_EXEC_CPU_ADD && !src1) ||
+      (op.op == EXSL_EXEC_CPU_CONV &&
+       (!src1 || (op.shape.has_bias && !bias))))
+    throw Error(EINVAL, "CPU layer operand missing");
+
+  switch (op.op) {
+  case EXSL_EXEC_CPU_COPY:
+    std::memcpy(dst, src, op.size);
+    break;
+  case EXSL_EXEC_CPU_ADD:
+    for (uint64_t i = 0; i < op.size; i++)
+      dst[i] = saturate(int16_t(src[i]) + src1[i]);
+    break;
+  case EXSL_EXEC_CPU_TO_SURFACE:
+    to_surface(op.shape, channel_atom, src, dst);
+    break;
+  case EXSL_EXEC_CPU_FROM_SURFACE:
+    from_surface(op.shape, channel_atom, src, dst);
+    break;
+  case EXSL_EXEC_CPU_CONV:
+    conv(op.shape, channel_atom, src, src1, bias, dst);
+    break;
+  default:
+    throw Error(EINVAL, "Unknown CPU layer");
+  }
+}
+
+} // namespace exsl
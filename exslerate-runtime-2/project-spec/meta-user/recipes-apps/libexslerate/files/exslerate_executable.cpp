@@ -0,0 +1,278 @@
+/* exslerate_executable.cpp - Loading and dispatching compiled models */
+#include "exslerate.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "exslerate_layer.hpp"
+
+namespace exsl {
+namespace {
+
+/* Bounds checked reads from an executable image */
+class Reader {
+public:
+  explicit Reader(const std::vector<uint8_t> &image) : image_(image) {}
+
+  const uint8_t *take(size_t size) {
+    if (size > image_.size() - pos_)
+      throw Error(EINVAL, "Executable truncated");
+
+    const uint8_t *ptr = image_.data() + pos_;
+    pos_ += (size + 7) & ~size_t(7);
+    pos_ = std::min(pos_, image_.size());
+    return ptr;
+  }
+
+  template <typename T> T get() {
+    T val;
+
+    std::memcpy(&val, take(sizeof(T)), sizeof(T));
+    return val;
+  }
+
+  const uint8_t *at(uint64_t offset, uint64_t size) const {
+    if (offset > image_.size() || size > image_.size() - offset)
+      throw Error(EINVAL, "Executable constant out of bounds");
+    return image_.data() + offset;
+  }
+
+private:
+  const std::vector<uint8_t> &image_;
+  size_t pos_ = 0;
+};
+
+bool cpu_op_valid(const exsl_exec_cpu_op &op) {
+  const exsl_conv_shape &s = op.shape;
+
+  switch (op.op) {
+  case EXSL_EXEC_CPU_COPY:
+  case EXSL_EXEC_CPU_ADD:
+    return op.size != 0;
+  case EXSL_EXEC_CPU_TO_SURFACE:
+  case EXSL_EXEC_CPU_FROM_SURFACE:
+    return s.channels && s.height && s.width;
+  case EXSL_EXEC_CPU_CONV:
+    return conv_shape_valid(s) && s.shift < 32;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+Executable::Executable(Device &dev, const std::vector<uint8_t> &image) {
+  Reader reader(image);
+  auto hdr = reader.get<exsl_exec_header>();
+  std::vector<BoSpec> specs;
+  std::vector<uint32_t> spec_binding;
+
+  if (hdr.magic != EXSL_EXEC_MAGIC || hdr.version != EXSL_EXEC_VERSION)
+    throw Error(ENOEXEC, "Not an ExSLerate executable");
+  if (!hdr.channel_atom)
+    throw Error(EINVAL, "Executable without a channel atom");
+  channel_atom_ = hdr.channel_atom;
+
+  for (uint32_t i = 0; i < hdr.binding_count; i++) {
+    auto binding = reader.get<exsl_exec_binding>();
+
+    if (!binding.size || binding.kind > EXSL_EXEC_BINDING_SCRATCH)
+      throw Error(EINVAL, "Invalid executable binding");
+
+    bindings_.push_back(binding);
+    if (binding.kind == EXSL_EXEC_BINDING_INPUT ||
+        binding.kind == EXSL_EXEC_BINDING_OUTPUT) {
+      io_index_.push_back(io_.size());
+      io_.push_back(binding);
+      continue;
+    }
+
+    io_index_.push_back(-1);
+    spec_binding.push_back(i);
+  }
+
+  for (uint32_t i = 0; i < hdr.layer_count; i++) {
+    auto hdr_layer = reader.get<exsl_exec_layer>();
+    const uint8_t *config = reader.take(hdr_layer.config_size);
+    Layer layer = {hdr_layer.core_type, {}, {}};
+
+    if (layer.core_type == EXSL_CONV_CORE &&
+        hdr_layer.config_size == sizeof(exsl_write_config_args)) {
+      exsl_write_config_args conv;
+      std::memcpy(&conv, config, sizeof(conv));
+      layer.desc = dev.create_desc(conv);
+    } else if (layer.core_type == EXSL_EXEC_CPU_CORE &&
+               hdr_layer.config_size == sizeof(exsl_exec_cpu_op)) {
+      std::memcpy(&layer.op, config, sizeof(layer.op));
+      if (!cpu_op_valid(layer.op))
+        throw Error(EINVAL, "Invalid executable CPU layer");
+    } else {
+      throw Error(EINVAL, "Invalid executable layer");
+    }
+    layers_.push_back(std::move(layer));
+  }
+
+  for (uint32_t i = 0; i < hdr.reloc_count; i++) {
+    auto reloc = reader.get<exsl_reloc>();
+
+    if (reloc.layer >= layers_.size() || reloc.bo_index >= bindings_.size())
+      throw Error(EINVAL, "Invalid executable relocation");
+    relocs_.push_back(reloc);
+  }
+  std::stable_sort(relocs_.begin(), relocs_.end(),
+                   [](const exsl_reloc &a, const exsl_reloc &b) {
+                     return a.layer < b.layer;
+                   });
+
+  /* The CPU touches what the relocations point at, keep it in bounds */
+  for (const auto &reloc : relocs_) {
+    const Layer &layer = layers_[reloc.layer];
+    uint64_t size = bindings_[reloc.bo_index].size;
+
+    if (layer.core_type != EXSL_EXEC_CPU_CORE)
+      continue;
+    if (reloc.slot >= EXSL_EXEC_CPU_NUM_SLOTS || reloc.offset > size ||
+        cpu_operand_size(layer.op, channel_atom_, reloc.slot) >
+            size - reloc.offset)
+      throw Error(EINVAL, "Invalid executable CPU operand");
+  }
+
+  /* Bias and LUT slots are 32-bit, those tables must sit below 4 GiB */
+  std::vector<bool> dma32(bindings_.size());
+  for (const auto &reloc : relocs_)
+    if (layers_[reloc.layer].core_type == EXSL_CONV_CORE &&
+        (reloc.slot == EXSL_RELOC_CONV_BIAS ||
+         reloc.slot == EXSL_RELOC_CONV_LUT))
+      dma32[reloc.bo_index] = true;
+
+  for (uint32_t index : spec_binding) {
+    const exsl_exec_binding &binding = bindings_[index];
+    uint64_t flags = 0;
+
+    /* Weights can be evicted from the pool, they are only relocated */
+    if (dma32[index])
+      flags = EXSL_BO_FLAG_DMA32;
+    else if (binding.kind == EXSL_EXEC_BINDING_CONSTANT)
+      flags = EXSL_BO_FLAG_EVICTABLE;
+    specs.push_back({binding.size, EXSL_BO_SHARE, flags});
+  }
+
+  /* All internal buffers in one ioctl, then the weights go in */
+  std::vector<Bo> bos;
+  if (!specs.empty())
+    bos = dev.create_bos(specs);
+  bos_.resize(bindings_.size());
+  for (size_t i = 0; i < bos.size(); i++) {
+    const exsl_exec_binding &binding = bindings_[spec_binding[i]];
+
+    if (binding.kind == EXSL_EXEC_BINDING_CONSTANT)
+      std::memcpy(bos[i].map(), reader.at(binding.data_offset, binding.size),
+                  binding.size);
+    bos_[spec_binding[i]] = std::move(bos[i]);
+  }
+}
+
+Executable Executable::load(Device &dev, const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file)
+    throw Error(errno, path.c_str());
+
+  std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+  return Executable(dev, image);
+}
+
+Bo &Executable::binding_bo(uint32_t binding, const std::vector<Bo *> &io) {
+  int32_t index = io_index_[binding];
+
+  return index < 0 ? bos_[binding] : *io[index];
+}
+
+void Executable::run_cpu(const Layer &layer, RelocIter begin, RelocIter end,
+                         const std::vector<Bo *> &io) {
+  uint8_t *operands[EXSL_EXEC_CPU_NUM_SLOTS] = {};
+  RelocIter reloc;
+
+  /* CPU_PREP waits for the jobs queued before to be done with them */
+  for (reloc = begin; reloc != end; reloc++) {
+    Bo &bo = binding_bo(reloc->bo_index, io);
+    uint64_t size = cpu_operand_size(layer.op, channel_atom_, reloc->slot);
+    uint32_t flags = reloc->slot == EXSL_EXEC_CPU_DST ? EXSL_CPU_SYNC_WRITE
+                                                      : EXSL_CPU_SYNC_READ;
+
+    bo.cpu_prep(flags, reloc->offset, size);
+    operands[reloc->slot] = static_cast<uint8_t *>(bo.map()) + reloc->offset;
+  }
+
+  cpu_run(layer.op, channel_atom_, operands);
+
+  for (reloc = begin; reloc != end; reloc++) {
+    uint32_t flags = reloc->slot == EXSL_EXEC_CPU_DST ? EXSL_CPU_SYNC_WRITE
+                                                      : EXSL_CPU_SYNC_READ;
+
+    binding_bo(reloc->bo_index, io)
+        .cpu_fini(flags, reloc->offset,
+                  cpu_operand_size(layer.op, channel_atom_, reloc->slot));
+  }
+}
+
+Fence Executable::dispatch(Context &ctx, const std::vector<Bo *> &io) {
+  auto reloc = relocs_.cbegin();
+  std::vector<Fence> fences;
+  size_t start;
+
+  if (io.size() != io_.size())
+    throw Error(EINVAL, "Wrong number of executable buffers");
+  for (size_t i = 0; i < io.size(); i++)
+    if (!io[i] || !*io[i] || io[i]->size() < io_[i].size)
+      throw Error(EINVAL, "Executable buffer too small");
+
+  for (start = 0; start < layers_.size();) {
+    uint32_t core_type = layers_[start].core_type;
+    size_t end = start;
+    Job job;
+
+    /* Surface a failed job before a CPU layer consumes its output */
+    if (core_type == EXSL_EXEC_CPU_CORE)
+      for (auto &fence : fences)
+        fence.wait();
+
+    /* A job runs on one core, so every change of core starts a new one */
+    for (; end < layers_.size() && layers_[end].core_type == core_type;
+         end++) {
+      RelocIter first = reloc;
+
+      while (reloc != relocs_.cend() && reloc->layer == end)
+        reloc++;
+
+      if (core_type == EXSL_EXEC_CPU_CORE) {
+        run_cpu(layers_[end], first, reloc, io);
+        continue;
+      }
+
+      /* Tiled layers can outgrow a job, go on in the next */
+      if (job.layer_count() == EXSL_MAX_JOB_LAYERS ||
+          job.bo_count() + (reloc - first) > EXSL_MAX_JOB_HANDLES) {
+        fences.push_back(ctx.submit(job));
+        job = Job();
+      }
+
+      uint32_t layer = job.add_layer(layers_[end].desc);
+      for (; first != reloc; first++)
+        job.reloc(layer, first->slot, binding_bo(first->bo_index, io),
+                  first->offset);
+    }
+
+    if (core_type != EXSL_EXEC_CPU_CORE)
+      fences.push_back(ctx.submit(job));
+    start = end;
+  }
+
+  return Fence(std::move(fences));
+}
+
+} // namespace exsl
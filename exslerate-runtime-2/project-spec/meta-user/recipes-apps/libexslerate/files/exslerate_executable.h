@@ -0,0 +1,105 @@
+/*
+ * ExSLerate executable: a compiled model as the layer configs the driver
+ * packs into descriptors, the buffers the layers use and where each
+ * buffer's address goes. All integers are little endian and every part
+ * starts 8 byte aligned:
+ *
+ *   struct exsl_exec_header
+ *   struct exsl_exec_binding[binding_count]
+ *   layer_count times struct exsl_exec_layer and its config
+ *   struct exsl_reloc[reloc_count], bo_index indexing the bindings
+ *   constant contents, at the data_offset of their binding
+ *
+ * Activations are int8 in the surface layout of the conv core: lines of
+ * every channel set interleaved, [H][C / channel_atom][W][channel_atom],
+ * with the channels of the last set zero padded. Filters are int8
+ * [F][C / channel_atom][KH][KW][channel_atom] and biases int32 [F].
+ */
+#ifndef _EXSLERATE_EXECUTABLE_H_
+#define _EXSLERATE_EXECUTABLE_H_
+
+#include <linux/types.h>
+
+#include "exslerate_ioctl.h"
+
+#define EXSL_EXEC_MAGIC 0x58535845 /* "EXSX" */
+#define EXSL_EXEC_VERSION 1
+
+struct exsl_exec_header {
+  __u32 magic;
+  __u32 version;
+  __u32 binding_count;
+  __u32 layer_count;
+  __u32 reloc_count;
+  __u32 channel_atom; /* Channels per set of the surface layout */
+};
+
+/*
+ * Inputs and outputs are passed to each dispatch, in binding order.
+ * Constants (weights, biases, LUTs) are loaded once from the file; scratch
+ * buffers hold activations between layers and are allocated at load.
+ */
+struct exsl_exec_binding {
+  __u64 size;
+  __u64 data_offset; /* CONSTANT: file offset of the contents */
+#define EXSL_EXEC_BINDING_INPUT 0
+#define EXSL_EXEC_BINDING_OUTPUT 1
+#define EXSL_EXEC_BINDING_CONSTANT 2
+#define EXSL_EXEC_BINDING_SCRATCH 3
+  __u32 kind;
+  __u32 pad;
+};
+
+/*
+ * Followed by config_size bytes of struct exsl_write_config_args for
+ * EXSL_CONV_CORE or exsl_exec_cpu_op for EXSL_EXEC_CPU_CORE, padded to 8.
+ */
+struct exsl_exec_layer {
+#define EXSL_EXEC_CPU_CORE 0x100 /* Runs on the host CPU */
+  __u32 core_type;
+  __u32 config_size;
+};
+
+/* A convolution as the model has it, int8 in and out */
+struct exsl_conv_shape {
+  __u32 channels, height, width; /* Input */
+  __u32 filters;
+  __u32 kernel_h, kernel_w;
+  __u32 stride_h, stride_w;
+  __u32 pad_h, pad_w;
+  __u32 dilation_h, dilation_w;
+  /*
+   * out = clamp(max(round((bias + sum) * scale >> shift), 0 if relu) +
+   *             zero_point, -128, 127)
+   */
+  __u32 has_bias;
+  __u32 relu;
+  __u32 scale;
+  __u32 shift;
+  __s32 zero_point;
+  __u32 pad;
+};
+
+/*
+ * Layers the device cannot run. Operands are relocated like device
+ * addresses, into the EXSL_EXEC_CPU_* slots.
+ */
+struct exsl_exec_cpu_op {
+#define EXSL_EXEC_CPU_COPY 0         /* size bytes from SRC to DST */
+#define EXSL_EXEC_CPU_ADD 1          /* DST = SRC + SRC1, size int8s */
+#define EXSL_EXEC_CPU_TO_SURFACE 2   /* NCHW SRC to surface DST, by shape */
+#define EXSL_EXEC_CPU_FROM_SURFACE 3 /* Surface SRC to NCHW DST, by shape */
+#define EXSL_EXEC_CPU_CONV 4         /* SRC * SRC1 filters + BIAS to DST */
+  __u32 op;
+  __u32 pad;
+  __u64 size;
+  struct exsl_conv_shape shape;
+};
+
+#define EXSL_EXEC_CPU_SRC 0
+#define EXSL_EXEC_CPU_SRC1 1
+#define EXSL_EXEC_CPU_BIAS 2
+#define EXSL_EXEC_CPU_DST 3
+#define EXSL_EXEC_CPU_NUM_SLOTS 4
+
+#endif /* _EXSLERATE_EXECUTABLE_H_ */
@@ -0,0 +1,485 @@
+/* exslerate_layer.cpp - Planning convolutions into conv core passes */
+#include "exslerate_layer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "exslerate.hpp"
+
+namespace exsl {
+namespace {
+
+uint32_t div_round_up(uint64_t n, uint32_t d) { return (n + d - 1) / d; }
+
+/* Smallest s with 1 << s >= n */
+uint32_t order_base_2(uint64_t n) {
+  uint32_t s = 0;
+
+  while ((uint64_t(1) << s) < n)
+    s++;
+  return s;
+}
+
+/* WDMA_CSR: go, burst size in bytes, AXI burst length - 1 */
+uint32_t wdma_csr(uint32_t burst_bytes, uint32_t burst_len) {
+  return 1 | (burst_bytes & 0xfff) << 1 | ((burst_len - 1) & 0x1ff) << 13;
+}
+
+/* Input rows or columns outputs [o, o + n) read, clipped to the input */
+struct Window {
+  uint32_t first, count;
+};
+
+Window conv_window(uint32_t o, uint32_t n, uint32_t stride, uint32_t pad,
+                   uint32_t kernel, uint32_t dilation, uint32_t size) {
+  int64_t first = int64_t(o) * stride - pad;
+  int64_t last = int64_t(o + n - 1) * stride - pad +
+                 int64_t(kernel - 1) * dilation;
+
+  first = std::max<int64_t>(first, 0);
+  last = std::min<int64_t>(last, int64_t(size) - 1);
+  if (last < first)
+    return {uint32_t(std::min<int64_t>(first, size)), 0};
+  return {uint32_t(first), uint32_t(last - first + 1)};
+}
+
+Window row_window(const exsl_conv_shape &conv, uint32_t oy, uint32_t n) {
+  return conv_window(oy, n, conv.stride_h, conv.pad_h, conv.kernel_h,
+                     conv.dilation_h, conv.height);
+}
+
+Window col_window(const exsl_conv_shape &conv, uint32_t ox, uint32_t n) {
+  return conv_window(ox, n, conv.stride_w, conv.pad_w, conv.kernel_w,
+                     conv.dilation_w, conv.width);
+}
+
+/*
+ * Output rows first_out, first_out + dilation_h, ... of a convolution: an
+ * undilated convolution over a view of the input whose lines are
+ * dilation_h rows apart, from input row first_row. The view keeps pad_h
+ * rows of padding at the top, and so at the bottom: the first full_h rows
+ * have the whole kernel in there, the rest only its leading rows.
+ */
+struct RowPhase {
+  exsl_conv_shape view;
+  uint32_t first_out, out_h, full_h;
+  uint32_t first_row;
+};
+
+/* The dilation_h row phases of a convolution, one if it is undilated */
+std::vector<RowPhase> row_phases(const exsl_conv_shape &conv) {
+  uint32_t d = conv.dilation_h, out_h = conv_out_h(conv);
+  std::vector<RowPhase> phases;
+
+  for (uint32_t p = 0; p < std::min(d, out_h); p++) {
+    /* Rows of the view are the input rows the phase's taps can land on */
+    int64_t y = int64_t(p) * conv.stride_h - conv.pad_h;
+    int64_t first = y >= 0 ? y : (y % d + d) % d;
+    RowPhase phase;
+
+    phase.view = conv;
+    phase.view.height =
+        first < conv.height ? (conv.height - 1 - first) / d + 1 : 0;
+    phase.view.pad_h = (first - y) / d;
+    phase.view.dilation_h = 1;
+    phase.first_out = p;
+    phase.out_h = div_round_up(out_h - p, d);
+    phase.full_h = 0;
+    if (uint64_t(phase.view.height) + 2 * phase.view.pad_h >= conv.kernel_h)
+      phase.full_h = std::min(phase.out_h, conv_out_h(phase.view));
+    phase.first_row = first;
+    phases.push_back(phase);
+  }
+  return phases;
+}
+
+/* The view of a phase, with the kernel rows output row oy of it gets */
+exsl_conv_shape phase_rows(const RowPhase &phase, uint32_t oy) {
+  exsl_conv_shape rows = phase.view;
+
+  if (oy >= phase.full_h)
+    rows.kernel_h = rows.height + 2 * rows.pad_h - oy * rows.stride_h;
+  return rows;
+}
+
+/* Bytes of one filter, all its channel sets */
+uint64_t filter_bytes(const Target &target, const exsl_conv_shape &conv) {
+  return uint64_t(div_round_up(conv.channels, target.channel_atom)) *
+         conv.kernel_h * conv.kernel_w * target.channel_atom;
+}
+
+/* Input bytes per pixel, all channel sets */
+uint64_t pixel_bytes(const Target &target, const exsl_conv_shape &conv) {
+  return uint64_t(div_round_up(conv.channels, target.channel_atom)) *
+         target.channel_atom;
+}
+
+/* Filter sets one pass can hold, 0 if not even one */
+uint32_t pass_filter_sets(const Target &target, const exsl_conv_shape &conv) {
+  uint64_t filt_ram = uint64_t(target.ram_banks) * target.filt_bank_bytes;
+  uint32_t sets = div_round_up(conv.filters, target.channel_atom);
+
+  if (conv.filters * filter_bytes(target, conv) <= filt_ram)
+    return sets;
+  return std::min<uint64_t>(
+      sets, filt_ram / (target.channel_atom * filter_bytes(target, conv)));
+}
+
+/* Sum of the windows of outputs [0, out) in tiles of tile */
+uint64_t window_sum(const exsl_conv_shape &conv, bool rows, uint32_t out,
+                    uint32_t tile) {
+  uint64_t sum = 0;
+
+  for (uint32_t o = 0; o < out; o += tile) {
+    uint32_t n = std::min(tile, out - o);
+    sum += rows ? row_window(conv, o, n).count : col_window(conv, o, n).count;
+  }
+  return sum;
+}
+
+/*
+ * The layer config of one pass, applying the leading taps rows of the
+ * kernel: filters stay packed whole, FILT_SIZE apart
+ */
+exsl_write_config_args pass_config(const Target &target,
+                                   const exsl_conv_shape &conv, uint32_t taps,
+                                   uint32_t oy, uint32_t th, uint32_t ox,
+                                   uint32_t tw, uint32_t set,
+                                   uint32_t filter_sets) {
+  uint32_t atom = target.channel_atom;
+  uint32_t sets = div_round_up(conv.channels, atom);
+  uint32_t out_h = conv_out_h(conv), out_w = conv_out_w(conv);
+  uint32_t filters = std::min(filter_sets * atom, conv.filters - set * atom);
+  Window rows = conv_window(oy, th, conv.stride_h, conv.pad_h, taps,
+                            conv.dilation_h, conv.height);
+  Window cols = col_window(conv, ox, tw);
+  uint32_t burst_bytes = target.burst_len * target.axi_beat_bytes;
+  uint64_t iact_bytes = uint64_t(rows.count) * cols.count * sets * atom;
+  uint64_t filt_bytes = filters * filter_bytes(target, conv);
+  uint64_t out_bytes = uint64_t(th) * tw * filter_sets * atom;
+  exsl_write_config_args cfg;
+
+  std::memset(&cfg, 0, sizeof(cfg));
+
+  /* Shape, of the whole convolution */
+  cfg.PADDING = conv.pad_h;
+  cfg.paddingW = conv.pad_w;
+  cfg.FILT_H = taps;
+  cfg.FILT_W = conv.kernel_w;
+  cfg.CHANNEL_SETS = sets;
+  cfg.filter_sets = filter_sets;
+  cfg.TOTAL_FIL_SETS = div_round_up(conv.filters, atom);
+  cfg.stride = conv.stride_w;
+  cfg.strideCX = conv.stride_w;
+  cfg.strideCY = conv.stride_h;
+  cfg.OACT_W = out_w;
+  cfg.OACT_H = out_h;
+  cfg.IACT_H = conv.height;
+  cfg.IACT_W = conv.width;
+
+  /* Surface layout: LINE_STRIDE is per channel set, the driver scales it */
+  cfg.LINE_STRIDE = conv.width * atom;
+  cfg.SURF_STRIDE = conv.width * atom;
+  cfg.featureLineStride = conv.width * atom * sets;
+  cfg.FILT_SIZE = filter_bytes(target, conv);
+
+  /* The output tile of this pass */
+  cfg.tile_width_offset = ox;
+  cfg.tile_height_offset = oy * out_w;
+  cfg.tile_width = tw;
+  cfg.tile_height = th;
+  cfg.outTileWidth = tw;
+  cfg.outTileHeight = th;
+  cfg.elemPerOutputTile = tw * th;
+  cfg.tileWidthShifter = order_base_2(tw);
+  cfg.tileHeightShifter = order_base_2(th);
+  cfg.tileSizeShifter = cfg.tileWidthShifter + cfg.tileHeightShifter;
+  cfg.elemPerInputTileShifter =
+      order_base_2(uint64_t(rows.count) * cols.count);
+
+  /* On-chip RAMs, in banks from bank 0 */
+  cfg.IACT_MAX_STRIPE = rows.count;
+  cfg.IACT_MAX_VALUE = iact_bytes;
+  cfg.ifMaxRam = std::max(div_round_up(iact_bytes, target.iact_bank_bytes),
+                          uint32_t(1)) -
+                 1;
+  cfg.flMaxStripe = filter_sets;
+  cfg.flMaxValue = filt_bytes;
+  cfg.flMaxRam = div_round_up(filt_bytes, target.filt_bank_bytes) - 1;
+
+  /* DMA */
+  cfg.ifBurstLen = target.burst_len;
+  cfg.flBurstLen = target.burst_len;
+  cfg.lifetimeBurstLen = target.burst_len;
+  cfg.wdmaCSR = wdma_csr(burst_bytes, target.burst_len);
+  cfg.wdma_transaction_num = div_round_up(out_bytes, burst_bytes);
+
+  /* UDP: bias, requantisation and ReLU */
+  cfg.enableBias = conv.has_bias;
+  cfg.biasSizebytes = conv.has_bias ? filters * 4 : 0;
+  cfg.BDMA_nof_batch = conv.has_bias;
+  cfg.enableRelu = conv.relu;
+  cfg.scalingFactor1 = conv.scale;
+  cfg.quant_shifter = conv.shift;
+  cfg.quant_zero_point = conv.zero_point;
+
+  cfg.globalInterruptEn = 1;
+  cfg.doneInterruptEn = 1;
+  cfg.errorInterruptEn = 1;
+  cfg.timeoutInterruptEn = 1;
+
+  return cfg;
+}
+
+} // namespace
+
+bool conv_shape_valid(const exsl_conv_shape &conv) {
+  if (!conv.channels || !conv.height || !conv.width || !conv.filters ||
+      !conv.kernel_h || !conv.kernel_w || !conv.stride_h || !conv.stride_w ||
+      !conv.dilation_h || !conv.dilation_w)
+    return false;
+
+  /* The dilated kernel has to fit the padded input */
+  return uint64_t(conv.kernel_h - 1) * conv.dilation_h <
+             uint64_t(conv.height) + 2 * conv.pad_h &&
+         uint64_t(conv.kernel_w - 1) * conv.dilation_w <
+             uint64_t(conv.width) + 2 * conv.pad_w;
+}
+
+uint32_t conv_out_h(const exsl_conv_shape &conv) {
+  return (conv.height + 2 * conv.pad_h -
+          (conv.kernel_h - 1) * conv.dilation_h - 1) /
+             conv.stride_h +
+         1;
+}
+
+uint32_t conv_out_w(const exsl_conv_shape &conv) {
+  return (conv.width + 2 * conv.pad_w - (conv.kernel_w - 1) * conv.dilation_w -
+          1) / conv.stride_w +
+         1;
+}
+
+uint64_t surface_size(const Target &target, uint32_t channels,
+                      uint32_t height, uint32_t width) {
+  return uint64_t(height) * div_round_up(channels, target.channel_atom) *
+         width * target.channel_atom;
+}
+
+exsl_conv_shape lower_conv(const exsl_conv_shape &conv) {
+  exsl_conv_shape lowered = conv;
+
+  /* Taps dilation_w apart are a kernel with zero columns between them */
+  lowered.kernel_w = (conv.kernel_w - 1) * conv.dilation_w + 1;
+  lowered.dilation_w = 1;
+  return lowered;
+}
+
+uint64_t filter_size(const Target &target, const exsl_conv_shape &conv) {
+  return conv.filters * filter_bytes(target, lower_conv(conv));
+}
+
+std::vector<int8_t> pack_filters(const Target &target,
+                                 const exsl_conv_shape &conv,
+                                 const int8_t *fchw) {
+  uint32_t atom = target.channel_atom;
+  uint32_t sets = div_round_up(conv.channels, atom);
+  uint32_t kh = conv.kernel_h, kw = conv.kernel_w, dw = conv.dilation_w;
+  uint32_t lowered_kw = lower_conv(conv).kernel_w;
+  std::vector<int8_t> out(filter_size(target, conv));
+
+  for (uint32_t f = 0; f < conv.filters; f++)
+    for (uint32_t c = 0; c < conv.channels; c++)
+      for (uint32_t y = 0; y < kh; y++)
+        for (uint32_t x = 0; x < kw; x++)
+          out[((((uint64_t)f * sets + c / atom) * kh + y) * lowered_kw +
+                x * dw) *
+                  atom +
+              c % atom] = fchw[(((uint64_t)f * conv.channels + c) * kh + y) *
+                                   kw +
+                               x];
+  return out;
+}
+
+const char *conv_unsupported(const Target &target,
+                             const exsl_conv_shape &shape) {
+  exsl_conv_shape conv = lower_conv(shape);
+  uint64_t iact_ram = uint64_t(target.ram_banks) * target.iact_bank_bytes;
+
+  /* Tiles go down to one output, of every channel and one filter set */
+  if (uint64_t(std::min(conv.kernel_h, conv.height)) *
+          std::min(conv.kernel_w, conv.width) * pixel_bytes(target, conv) >
+      iact_ram)
+    return "one output's input does not fit the IACT RAM";
+  if (!pass_filter_sets(target, conv))
+    return "one filter set does not fit the filter RAM";
+
+  /* Rows apart are read through a view, its last row needs a tap of it */
+  for (const auto &phase : row_phases(conv))
+    if (!phase.view.height ||
+        uint64_t(phase.out_h - 1) * conv.stride_h >=
+            uint64_t(phase.view.height) + 2 * phase.view.pad_h)
+      return "a phase of output rows reads only padding";
+
+  return nullptr;
+}
+
+ConvPlan plan_conv(const Target &target, const exsl_conv_shape &shape) {
+  exsl_conv_shape conv = lower_conv(shape);
+  std::vector<RowPhase> phases = row_phases(conv);
+  uint64_t iact_ram = uint64_t(target.ram_banks) * target.iact_bank_bytes;
+  uint32_t out_h = conv_out_h(conv), out_w = conv_out_w(conv);
+  uint32_t atom = target.channel_atom;
+  uint32_t total_sets = div_round_up(conv.filters, atom);
+  uint32_t span_w = conv.kernel_w;
+  uint64_t line = pixel_bytes(target, conv) * conv.width;
+  uint32_t sets = pass_filter_sets(target, conv);
+  uint32_t filter_passes, view_h = 0, full_h = 1;
+  uint64_t tiles = 0;
+  ConvPlan plan = {};
+
+  for (const auto &phase : phases) {
+    view_h = std::max(view_h, phase.view.height);
+    full_h = std::max(full_h, phase.full_h);
+  }
+
+  /* As many filter sets per pass as fit, spread evenly over the passes */
+  filter_passes = div_round_up(total_sets, sets);
+  plan.filter_sets = div_round_up(total_sets, filter_passes);
+  plan.dram_bytes = UINT64_MAX;
+
+  /*
+   * For each tile height, the widest tile whose window fits the IACT RAM:
+   * both RAMs are fixed, so wider only saves halo and filter reloads.
+   * Heights giving the same number of bands are only tried evened out.
+   * Tiles are of the full rows of a row phase, the other rows are a band
+   * each.
+   */
+  for (uint32_t th = 1; th <= full_h; th++) {
+    uint32_t bands = 0, columns, tw;
+    uint64_t rows, row_sum = 0, max_cols, bytes;
+
+    if (div_round_up(full_h, div_round_up(full_h, th)) != th)
+      continue;
+
+    for (const auto &phase : phases) {
+      bands += div_round_up(phase.full_h, th) + phase.out_h - phase.full_h;
+      row_sum += window_sum(phase.view, true, phase.full_h, th);
+      for (uint32_t oy = phase.full_h; oy < phase.out_h; oy++)
+        row_sum += row_window(phase_rows(phase, oy), oy, 1).count;
+    }
+    rows = std::min(uint64_t(th - 1) * conv.stride_h + conv.kernel_h,
+                    uint64_t(view_h));
+    max_cols = iact_ram / (rows * pixel_bytes(target, conv));
+    if (max_cols >= conv.width)
+      tw = out_w;
+    else if (max_cols >= span_w)
+      tw = std::min<uint64_t>(out_w, (max_cols - span_w) / conv.stride_w + 1);
+    else
+      break; /* Taller tiles only leave less room */
+
+    columns = div_round_up(out_w, tw);
+    tw = div_round_up(out_w, columns);
+
+    /* Windows are reloaded per filter pass, filters per tile */
+    bytes = filter_passes * row_sum * window_sum(conv, false, out_w, tw) *
+            pixel_bytes(target, conv);
+    bytes += uint64_t(bands) * columns * conv.filters *
+             (filter_bytes(target, conv) + (conv.has_bias ? 4 : 0));
+    bytes += surface_size(target, conv.filters, out_h, out_w);
+
+    if (bytes < plan.dram_bytes ||
+        (bytes == plan.dram_bytes && uint64_t(bands) * columns < tiles)) {
+      plan.dram_bytes = bytes;
+      plan.tile_h = th;
+      plan.tile_w = tw;
+      tiles = uint64_t(bands) * columns;
+    }
+  }
+
+  /*
+   * A pass per run of filter sets, row phase and output tile. A phase reads
+   * input lines and writes output lines dilation_h rows apart: LINE_STRIDE
+   * and, for the output, TOTAL_FIL_SETS are scaled by dilation_h. Rows past
+   * full_h get a pass each, with FILT_H cut to the taps that reach the
+   * view's padding.
+   */
+  for (uint32_t set = 0; set < total_sets; set += plan.filter_sets) {
+    uint32_t pass_sets = std::min(plan.filter_sets, total_sets - set);
+
+    for (const auto &phase : phases) {
+      uint32_t th;
+
+      for (uint32_t oy = 0; oy < phase.out_h; oy += th) {
+        th = oy < phase.full_h ? std::min(plan.tile_h, phase.full_h - oy) : 1;
+
+        for (uint32_t ox = 0; ox < out_w; ox += plan.tile_w) {
+          uint32_t tw = std::min(plan.tile_w, out_w - ox);
+          ConvPass pass = {};
+
+          pass.config =
+              pass_config(target, phase.view, phase_rows(phase, oy).kernel_h,
+                          oy, th, ox, tw, set, pass_sets);
+          pass.config.OACT_H = phase.out_h;
+          pass.config.TOTAL_FIL_SETS *= conv.dilation_h;
+          pass.config.LINE_STRIDE *= conv.dilation_h;
+          pass.config.featureLineStride *= conv.dilation_h;
+          pass.input_offset = phase.first_row * line;
+          pass.filter_offset =
+              uint64_t(set) * atom * filter_bytes(target, conv);
+          pass.bias_offset = uint64_t(set) * atom * 4;
+          pass.output_offset =
+              (uint64_t(phase.first_out) * total_sets + set) * out_w * atom;
+          plan.passes.push_back(pass);
+        }
+      }
+    }
+  }
+
+  return plan;
+}
+
+std::vector<Job> conv_jobs(const ConvPlan &plan,
+                           const std::vector<Descriptor> &descs,
+                           const Bo &input, const Bo &filters, const Bo *bias,
+                           const Bo &output) {
+  std::vector<Job> jobs;
+
+  /* At most four BOs, so only the layer limit splits */
+  for (size_t i = 0; i < plan.passes.size(); i++) {
+    const ConvPass &pass = plan.passes[i];
+
+    if (i % EXSL_MAX_JOB_LAYERS == 0)
+      jobs.emplace_back();
+
+    Job &job = jobs.back();
+    uint32_t layer = job.add_layer(descs[i]);
+
+    job.reloc(layer, EXSL_RELOC_CONV_IFMAP, input, pass.input_offset);
+    job.reloc(layer, EXSL_RELOC_CONV_FILTER, filters, pass.filter_offset);
+    if (bias)
+      job.reloc(layer, EXSL_RELOC_CONV_BIAS, *bias, pass.bias_offset);
+    job.reloc(layer, EXSL_RELOC_CONV_OUTPUT, output, pass.output_offset);
+  }
+
+  return jobs;
+}
+
+ConvLayer::ConvLayer(Device &dev, const exsl_conv_shape &conv,
+                     const Target &target) {
+  const char *why = conv_unsupported(target, conv);
+
+  if (!conv_shape_valid(conv) || why)
+    throw Error(EINVAL, why ? why : "Invalid convolution");
+
+  plan_ = plan_conv(target, conv);
+  for (const auto &pass : plan_.passes)
+    descs_.push_back(dev.create_desc(pass.config));
+}
+
+std::vector<Job> ConvLayer::jobs(const Bo &input, const Bo &filters,
+                                 const Bo *bias, const Bo &output) const {
+  return conv_jobs(plan_, descs_, input, filters, bias, output);
+}
+
+} // namespace exsl
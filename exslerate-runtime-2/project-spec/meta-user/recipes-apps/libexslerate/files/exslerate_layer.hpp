@@ -0,0 +1,146 @@
+/*
+ * exslerate_layer.hpp - Planning convolutions into conv core passes, and
+ * the CPU kernels of the layers that stay on the host
+ */
+#ifndef _EXSLERATE_LAYER_HPP_
+#define _EXSLERATE_LAYER_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "exslerate.hpp"
+#include "exslerate_executable.h"
+#include "exslerate_ioctl.h"
+
+namespace exsl {
+
+/*
+ * The conv core a model is compiled for. The array shape is that of the
+ * exsleratev2 target conv_only.vmfb was built for; its 3x3 filters of 3
+ * channels take 288 bytes, a channel atom of 32. The IACT and filter RAMs
+ * are counted in banks, ifMaxRam and flMaxRam selecting up to 16.
+ */
+struct Target {
+  uint32_t clusters = 8;
+  uint32_t multipliers = 16;
+  uint32_t pes = 4;
+  uint32_t channel_atom = 32;
+  uint32_t ram_banks = 16;
+  uint32_t iact_bank_bytes = 4096;
+  uint32_t filt_bank_bytes = 4096;
+  uint32_t axi_beat_bytes = 16;
+  uint32_t burst_len = 16; /* AXI beats per DMA burst */
+};
+
+uint32_t conv_out_h(const exsl_conv_shape &conv);
+uint32_t conv_out_w(const exsl_conv_shape &conv);
+
+/* Bytes of a tensor in the surface layout */
+uint64_t surface_size(const Target &target, uint32_t channels,
+                      uint32_t height, uint32_t width);
+/*
+ * The convolution the core runs for conv: dilation along W becomes a wider
+ * kernel with zero columns between the taps. Dilation along H stays, it is
+ * run as strided sub-convolutions (see plan_conv()).
+ */
+exsl_conv_shape lower_conv(const exsl_conv_shape &conv);
+
+/* Bytes of the filters of a conv in the filter layout, once lowered */
+uint64_t filter_size(const Target &target, const exsl_conv_shape &conv);
+
+/* Reorder FCHW int8 weights into the filter layout of lower_conv(conv) */
+std::vector<int8_t> pack_filters(const Target &target,
+                                 const exsl_conv_shape &conv,
+                                 const int8_t *fchw);
+
+/*
+ * Why the conv core cannot run a convolution, or nullptr if it can. The
+ * compiler leaves those to EXSL_EXEC_CPU_CONV, on lower_conv(conv).
+ */
+const char *conv_unsupported(const Target &target,
+                             const exsl_conv_shape &conv);
+
+/*
+ * A convolution runs as passes of the conv core, one layer each, a pass
+ * computing an output tile for a run of filter sets. The tile is
+ * tile_width x tile_height outputs from column tile_width_offset and
+ * element tile_height_offset (its first row times OACT_W). The core loads
+ * the tile's input window into the IACT RAM: halo included, clipped to the
+ * input and padded where it leaves it, so the windows of neighbouring
+ * tiles overlap by the halo. Each pass computes filter_sets of the
+ * TOTAL_FIL_SETS output channel sets, with the filters, biases and output
+ * relocated to the offsets of its first set.
+ *
+ * Dilated along H, output rows dilation_h apart are an undilated
+ * convolution over a view of the input whose lines are dilation_h rows
+ * apart: LINE_STRIDE and TOTAL_FIL_SETS, the output's line stride, are
+ * scaled by dilation_h. Bottom rows of such a phase that run past its
+ * padding get a pass each, with FILT_H cut to the kernel's leading rows.
+ */
+struct ConvPass {
+  exsl_write_config_args config;
+  uint64_t input_offset;  /* In the input surface */
+  uint64_t filter_offset; /* In the pack_filters() layout */
+  uint64_t bias_offset;
+  uint64_t output_offset; /* In the output surface */
+};
+
+struct ConvPlan {
+  uint32_t tile_h, tile_w; /* Output tile, smaller at the bottom and right */
+  uint32_t filter_sets;    /* Filter sets per pass, fewer in the last */
+  uint64_t dram_bytes;     /* Read and written by all passes */
+  std::vector<ConvPass> passes;
+};
+
+/*
+ * Lower a convolution conv_unsupported() accepts with lower_conv() and
+ * tile it into passes that fit the RAMs, picking the tile shape that moves
+ * the fewest bytes to and from DRAM. Linear in the output height, so cheap
+ * enough to run at layer creation as well as in the compiler.
+ */
+ConvPlan plan_conv(const Target &target, const exsl_conv_shape &conv);
+
+/*
+ * The jobs running a plan, one descriptor per pass, split where a job
+ * would exceed EXSL_MAX_JOB_LAYERS. Submitted in order on one context
+ * they run the passes in order. bias may be null if the shape has none.
+ */
+std::vector<Job> conv_jobs(const ConvPlan &plan,
+                           const std::vector<Descriptor> &descs,
+                           const Bo &input, const Bo &filters, const Bo *bias,
+                           const Bo &output);
+
+/* A convolution planned at runtime, its passes packed into descriptors */
+class ConvLayer {
+public:
+  ConvLayer(Device &dev, const exsl_conv_shape &conv,
+            const Target &target = Target());
+
+  const ConvPlan &plan() const { return plan_; }
+
+  /*
+   * The jobs running the passes, see conv_jobs(). Filters are in the
+   * pack_filters() layout; bias may be null if the shape has none.
+   */
+  std::vector<Job> jobs(const Bo &input, const Bo &filters, const Bo *bias,
+                        const Bo &output) const;
+
+private:
+  ConvPlan plan_;
+  std::vector<Descriptor> descs_;
+};
+
+/* Whether a shape describes a convolution with a non-empty output */
+bool conv_shape_valid(const exsl_conv_shape &conv);
+
+/* Bytes a CPU layer accesses through an operand slot, 0 if unused */
+uint64_t cpu_operand_size(const exsl_exec_cpu_op &op, uint32_t channel_atom,
+                          uint32_t slot);
+
+/* Run a CPU layer on its mapped operands, indexed by EXSL_EXEC_CPU_* */
+void cpu_run(const exsl_exec_cpu_op &op, uint32_t channel_atom,
+             uint8_t *const operands[EXSL_EXEC_CPU_NUM_SLOTS]);
+
+} // namespace exsl
+
+#endif /* _EXSLERATE_LAYER_HPP_ */
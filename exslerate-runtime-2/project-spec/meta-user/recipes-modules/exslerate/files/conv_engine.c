@@ -16,211 +16,395 @@
 
 #define CSR_DEBUG 0
 
-int program_convolution_core(struct exslerate_device *dev) {
-  struct exsl_write_config_args *params = &dev->conv_config;
+/* CSRs making up a layer image, in the order they are written */
+static const uint16_t conv_layer_csrs[] = {
+    /* Convolution core */
+    CSR_CC_MAPPING, CSR_CC_PADDING_H, CSR_CC_KERNEL_H, CSR_CC_KERNEL_W,
+    CSR_CC_CHANNEL_SETS, CSR_CC_STRIDE_W, CSR_CC_OUT_WIDTH, CSR_CC_OUT_HEIGHT,
+    CSR_CC_LINE_STRIDE, CSR_CC_FILTER_SIZE, CSR_CC_SURF_STRIDE,
+    CSR_CC_TOTAL_FILTER_SETS, CSR_CC_FEATURE_H, CSR_CC_FEATURE_W,
+    CSR_CC_TILE_WIDTH_OFFSET, CSR_CC_TILE_HEIGHT_OFFSET, CSR_CC_TILE_WIDTH,
+    CSR_CC_TILE_HEIGHT, CSR_CC_STRIDE_H, CSR_CC_STRIDE_CX, CSR_CC_STRIDE_CY,
+    CSR_CC_IACT_MAX_RAM, CSR_CC_IACT_MAX_STRIPE, CSR_CC_IACT_MAX_VALUE,
+    CSR_CC_IACT_BURST_LEN, CSR_CC_FILT_MAX_RAM, CSR_CC_FILT_MAX_STRIPE,
+    CSR_CC_FILT_MAX_VALUE, CSR_CC_FILT_BURST_LEN, CSR_CC_LIFETIME_ADDR_OFFSET,
+    CSR_CC_LIFETIME_BURST_LEN, CSR_OUT_TILE_HEIGHT, CSR_OUT_TILE_WIDTH,
+    CSR_TILE_SIZE_SHIFTER, CSR_TILE_WIDTH_SHIFTER,
+    CSR_ELEM_PER_INPUT_TILE_SHIFTER, CSR_ELEM_PER_OUTPUT_TILE,
+    CSR_TILE_HEIGHT_SHIFTER, CSR_PADDING_W, CSR_SPECIAL_FUNCTION,
+
+    /* UDP core */
+    CSR_UDP_SCALE_A, CSR_UDP_SCALE_B, CSR_UDP_LUT_FACTOR,
+    CSR_UDP_LUT_SUB_FACTOR_0, CSR_UDP_LUT_SUB_FACTOR_1, CSR_UDP_LUT_ZERO_POINT,
+    CSR_UDP_SCALE_N_ZERO_POINT, CSR_UDP_LAYER_NORM_B,
+    CSR_UDP_BIAS_DMA_ADDR_OFFSET, CSR_UDP_CONTROL_DEMUX, CSR_WDMA_CSR,
+    CSR_WDMA_AXI_CSR, CSR_RDMA_AXI_CSR, CSR_WDMA_TRANSACTION_NUM,
+    CSR_GLOBAL_INTERRUPT_EN, CSR_INTERRUPT_EN, CSR_STALL_COUNT,
+
+    /* Addresses */
+    CSR_CC_IACT_BASE_ADDR_LOW, CSR_CC_IACT_BASE_ADDR_HIGH,
+    CSR_CC_FILT_BASE_ADDR_LOW, CSR_CC_FILT_BASE_ADDR_HIGH,
+    CSR_CC_LIFETIME_BASE_ADDR_LOW, CSR_CC_LIFETIME_BASE_ADDR_HIGH,
+    CSR_UDP_LUT_BASE_ADDR, CSR_UDP_BIAS_BASE_ADDR,
+    CSR_UDP_BN_BIAS_BASE_ADDR_LOW, CSR_UDP_BN_BIAS_BASE_ADDR_HIGH,
+    CSR_UDP_BN_WEIGHT_BASE_ADDR_LOW, CSR_UDP_BN_WEIGHT_BASE_ADDR_HIGH,
+    CSR_AXI_OUTPUT_BASE_ADDR_LOW, CSR_AXI_OUTPUT_BASE_ADDR_HIGH,
+};
+
+/* Config fields that are packed into a register field of limited width */
+struct conv_field_limit {
+  const char *name;
+  size_t offset;
+  uint32_t width;
+};
+
+#define CONV_FIELD(field, w)                                                   \
+  { #field, offsetof(struct exsl_write_config_args, field), w }
+
+static const struct conv_field_limit conv_field_limits[] = {
+    CONV_FIELD(pooling_type, 2),
+    CONV_FIELD(ifMaxRam, 4),
+    CONV_FIELD(ifOffset, 5),
+    CONV_FIELD(flMaxRam, 4),
+    CONV_FIELD(flOffset, 5),
+    CONV_FIELD(specialFilterSets, 11),
+    CONV_FIELD(specialSurfaceStride, 8),
+    CONV_FIELD(specialFixedVal, 8),
+    CONV_FIELD(BDMA_adrr_offset, 5),
+    CONV_FIELD(BNDMA_addr_offset, 5),
+    CONV_FIELD(clipped_scale, 8),
+    CONV_FIELD(PreRelu_scale, 8),
+    CONV_FIELD(csrdmux, 2),
+    CONV_FIELD(enableBias, 1),
+    CONV_FIELD(enableBatchNorm, 1),
+    CONV_FIELD(enableRelu, 1),
+    CONV_FIELD(enablePRelu, 1),
+    CONV_FIELD(enableSQRelu, 1),
+    CONV_FIELD(enableclippedRelu, 1),
+    CONV_FIELD(csrmode, 3),
+    CONV_FIELD(doneInterruptEn, 1),
+    CONV_FIELD(errorInterruptEn, 1),
+    CONV_FIELD(timeoutInterruptEn, 1),
+    CONV_FIELD(stallEn, 1),
+    CONV_FIELD(stallCountValue, 31),
+};
+
+static inline void regs_set(struct conv_layer_regs *regs, uint32_t offset,
+                            uint32_t value) {
+  regs->val[offset >> 2] = value;
+}
+
+/* Reject configs the register builders would silently truncate */
+static int conv_layer_validate(const struct exsl_write_config_args *params) {
+  const struct conv_field_limit *limit;
   uint32_t val;
+  size_t i;
+
+  for (i = 0; i < ARRAY_SIZE(conv_field_limits); i++) {
+    limit = &conv_field_limits[i];
+    val = *(const uint32_t *)((const uint8_t *)params + limit->offset);
+    if (val > GEN_MASK(limit->width)) {
+      DRM_ERROR("Layer config %s out of range: %u\n", limit->name, val);
+      return -EINVAL;
+    }
+  }
+
+  if (!params->tile_width || !params->tile_height) {
+    DRM_ERROR("Layer config has an empty tile: %ux%u\n", params->tile_width,
+              params->tile_height);
+    return -EINVAL;
+  }
 
-  DRM_INFO("Programming Convolution Core\n");
+  /* The UDP bias and LUT base CSRs have no high half */
+  if (upper_32_bits(params->biasBaseAddr)) {
+    DRM_ERROR("Bias address 0x%llx above 4 GiB\n", params->biasBaseAddr);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+static void pack_convolution_core(struct conv_layer_regs *regs,
+                                  const struct exsl_write_config_args *params) {
+  uint32_t val;
 
   /* Basic convolution parameters */
-  reg_write(dev, CSR_CC_MAPPING, BUILD_CC_MAPPING(params->pooling_type));
-  reg_write(dev, CSR_CC_PADDING_H, params->PADDING);
-  reg_write(dev, CSR_CC_KERNEL_H, params->FILT_H);
-  reg_write(dev, CSR_CC_KERNEL_W, params->FILT_H);
-  reg_write(dev, CSR_CC_CHANNEL_SETS, params->CHANNEL_SETS);
-  reg_write(dev, CSR_CC_STRIDE_W, params->stride);
-  reg_write(dev, CSR_CC_OUT_WIDTH, params->OACT_W);
-  reg_write(dev, CSR_CC_OUT_HEIGHT, params->OACT_H);
-  reg_write(dev, CSR_CC_LINE_STRIDE,
-            params->LINE_STRIDE * params->CHANNEL_SETS);
-  reg_write(dev, CSR_CC_FILTER_SIZE, params->FILT_SIZE);
-  reg_write(dev, CSR_CC_SURF_STRIDE, params->SURF_STRIDE);
-  reg_write(dev, CSR_CC_TOTAL_FILTER_SETS, params->TOTAL_FIL_SETS);
-  reg_write(dev, CSR_CC_FEATURE_H, params->IACT_H);
-  reg_write(dev, CSR_CC_FEATURE_W, params->IACT_W);
+  regs_set(regs, CSR_CC_MAPPING, BUILD_CC_MAPPING(params->pooling_type));
+  regs_set(regs, CSR_CC_PADDING_H, params->PADDING);
+  regs_set(regs, CSR_CC_KERNEL_H, params->FILT_H);
+  regs_set(regs, CSR_CC_KERNEL_W,
+           params->FILT_W ? params->FILT_W : params->FILT_H);
+  regs_set(regs, CSR_CC_CHANNEL_SETS, params->CHANNEL_SETS);
+  regs_set(regs, CSR_CC_STRIDE_W, params->stride);
+  regs_set(regs, CSR_CC_OUT_WIDTH, params->OACT_W);
+  regs_set(regs, CSR_CC_OUT_HEIGHT, params->OACT_H);
+  regs_set(regs, CSR_CC_LINE_STRIDE,
+           params->LINE_STRIDE * params->CHANNEL_SETS);
+  regs_set(regs, CSR_CC_FILTER_SIZE, params->FILT_SIZE);
+  regs_set(regs, CSR_CC_SURF_STRIDE, params->SURF_STRIDE);
+  regs_set(regs, CSR_CC_TOTAL_FILTER_SETS, params->TOTAL_FIL_SETS);
+  regs_set(regs, CSR_CC_FEATURE_H, params->IACT_H);
+  regs_set(regs, CSR_CC_FEATURE_W, params->IACT_W);
 
   /* Tile configuration */
-  reg_write(dev, CSR_CC_TILE_WIDTH_OFFSET, params->tile_width_offset);
-  reg_write(dev, CSR_CC_TILE_HEIGHT_OFFSET,
-            params->tile_height_offset + params->tile_width_offset);
-  reg_write(dev, CSR_CC_TILE_WIDTH, params->tile_width - 1);
-  reg_write(dev, CSR_CC_TILE_HEIGHT, params->tile_height - 1);
-  reg_write(dev, CSR_CC_STRIDE_H, params->strideCY);
-  reg_write(dev, CSR_CC_STRIDE_CX, params->stride);
-  reg_write(dev, CSR_CC_STRIDE_CY, params->strideCY);
+  regs_set(regs, CSR_CC_TILE_WIDTH_OFFSET, params->tile_width_offset);
+  regs_set(regs, CSR_CC_TILE_HEIGHT_OFFSET,
+           params->tile_height_offset + params->tile_width_offset);
+  regs_set(regs, CSR_CC_TILE_WIDTH, params->tile_width - 1);
+  regs_set(regs, CSR_CC_TILE_HEIGHT, params->tile_height - 1);
+  regs_set(regs, CSR_CC_STRIDE_H, params->strideCY);
+  regs_set(regs, CSR_CC_STRIDE_CX,
+           params->strideCX ? params->strideCX : params->stride);
+  regs_set(regs, CSR_CC_STRIDE_CY, params->strideCY);
 
   /* Input activation configuration */
-  reg_write(dev, CSR_CC_IACT_MAX_RAM,
-            BUILD_IACT_MAX_RAM(params->ifMaxRam, params->ifOffset));
-  reg_write(dev, CSR_CC_IACT_MAX_STRIPE, params->IACT_MAX_STRIPE);
-  reg_write(dev, CSR_CC_IACT_MAX_VALUE, params->IACT_MAX_VALUE);
-  reg_write(dev, CSR_CC_IACT_BURST_LEN, params->ifBurstLen);
+  regs_set(regs, CSR_CC_IACT_MAX_RAM,
+           BUILD_IACT_MAX_RAM(params->ifMaxRam, params->ifOffset));
+  regs_set(regs, CSR_CC_IACT_MAX_STRIPE, params->IACT_MAX_STRIPE);
+  regs_set(regs, CSR_CC_IACT_MAX_VALUE, params->IACT_MAX_VALUE);
+  regs_set(regs, CSR_CC_IACT_BURST_LEN, params->ifBurstLen);
 
   /* Filter configuration */
-  reg_write(dev, CSR_CC_FILT_MAX_RAM,
-            BUILD_FILT_MAX_RAM(params->flMaxRam, params->flOffset));
-  reg_write(dev, CSR_CC_FILT_MAX_STRIPE, params->flMaxStripe);
-  reg_write(dev, CSR_CC_FILT_MAX_VALUE, params->flMaxValue);
-  reg_write(dev, CSR_CC_FILT_BURST_LEN, params->flBurstLen);
+  regs_set(regs, CSR_CC_FILT_MAX_RAM,
+           BUILD_FILT_MAX_RAM(params->flMaxRam, params->flOffset));
+  regs_set(regs, CSR_CC_FILT_MAX_STRIPE, params->flMaxStripe);
+  regs_set(regs, CSR_CC_FILT_MAX_VALUE, params->flMaxValue);
+  regs_set(regs, CSR_CC_FILT_BURST_LEN, params->flBurstLen);
 
   /* Lifetime configuration */
-  reg_write(dev, CSR_CC_LIFETIME_ADDR_OFFSET, params->lifeTimeOffset);
-  reg_write(dev, CSR_CC_LIFETIME_BURST_LEN, params->lifetimeBurstLen);
+  regs_set(regs, CSR_CC_LIFETIME_ADDR_OFFSET, params->lifeTimeOffset);
+  regs_set(regs, CSR_CC_LIFETIME_BURST_LEN, params->lifetimeBurstLen);
 
   /* Special function and tile registers */
-  reg_write(dev, CSR_OUT_TILE_HEIGHT, params->outTileHeight);
-  reg_write(dev, CSR_OUT_TILE_WIDTH, params->outTileWidth);
-  reg_write(dev, CSR_TILE_SIZE_SHIFTER, params->tileSizeShifter);
-  reg_write(dev, CSR_TILE_WIDTH_SHIFTER, params->tileWidthShifter);
-  reg_write(dev, CSR_ELEM_PER_INPUT_TILE_SHIFTER,
-            params->elemPerInputTileShifter);
-  reg_write(dev, CSR_ELEM_PER_OUTPUT_TILE, params->elemPerOutputTile);
-  reg_write(dev, CSR_TILE_HEIGHT_SHIFTER, params->tileHeightShifter);
-  reg_write(dev, CSR_PADDING_W, params->paddingW);
+  regs_set(regs, CSR_OUT_TILE_HEIGHT, params->outTileHeight);
+  regs_set(regs, CSR_OUT_TILE_WIDTH, params->outTileWidth);
+  regs_set(regs, CSR_TILE_SIZE_SHIFTER, params->tileSizeShifter);
+  regs_set(regs, CSR_TILE_WIDTH_SHIFTER, params->tileWidthShifter);
+  regs_set(regs, CSR_ELEM_PER_INPUT_TILE_SHIFTER,
+           params->elemPerInputTileShifter);
+  regs_set(regs, CSR_ELEM_PER_OUTPUT_TILE, params->elemPerOutputTile);
+  regs_set(regs, CSR_TILE_HEIGHT_SHIFTER, params->tileHeightShifter);
+  regs_set(regs, CSR_PADDING_W, params->paddingW);
 
   /* Special function register */
   val = BUILD_SPECIAL_FUNCTION(params->specialFilterSets,
                                params->specialSurfaceStride,
                                params->specialFixedVal);
-  reg_write(dev, CSR_SPECIAL_FUNCTION, val);
-
-  DRM_INFO("Convolution Core programming completed\n");
-  return 0;
+  regs_set(regs, CSR_SPECIAL_FUNCTION, val);
 }
 
-int program_udp_core(struct exslerate_device *dev) {
-  struct exsl_write_config_args *params = &dev->conv_config;
+static void pack_udp_core(struct conv_layer_regs *regs,
+                          const struct exsl_write_config_args *params) {
   uint32_t val;
 
-  DRM_INFO("Programming UDP Core\n");
-
   /* Scaling and quantization parameters */
-  reg_write(dev, CSR_UDP_SCALE_A, params->scalingFactor1);
-  reg_write(dev, CSR_UDP_SCALE_B, params->scalingFactor2);
-  reg_write(dev, CSR_UDP_LUT_FACTOR, params->lutFactor);
-  reg_write(dev, CSR_UDP_LUT_SUB_FACTOR_0, params->lutSubFactor0);
-  reg_write(dev, CSR_UDP_LUT_SUB_FACTOR_1, params->lutSubFactor1);
-  reg_write(dev, CSR_UDP_LUT_ZERO_POINT, params->lutZeroPoint);
-  reg_write(dev, CSR_UDP_SCALE_N_ZERO_POINT, params->_k);
-  reg_write(dev, CSR_UDP_LAYER_NORM_B, params->layerNormB);
+  regs_set(regs, CSR_UDP_SCALE_A, params->scalingFactor1);
+  regs_set(regs, CSR_UDP_SCALE_B, params->scalingFactor2);
+  regs_set(regs, CSR_UDP_LUT_FACTOR, params->lutFactor);
+  regs_set(regs, CSR_UDP_LUT_SUB_FACTOR_0, params->lutSubFactor0);
+  regs_set(regs, CSR_UDP_LUT_SUB_FACTOR_1, params->lutSubFactor1);
+  regs_set(regs, CSR_UDP_LUT_ZERO_POINT, params->lutZeroPoint);
+  regs_set(regs, CSR_UDP_SCALE_N_ZERO_POINT, params->_k);
+  regs_set(regs, CSR_UDP_LAYER_NORM_B, params->layerNormB);
 
   /* Bias DMA configuration */
   val = BUILD_UDP_BIAS_DMA_OFFSET(params->BDMA_adrr_offset,
                                   params->BNDMA_addr_offset,
                                   params->clipped_scale, params->PreRelu_scale);
-  reg_write(dev, CSR_UDP_BIAS_DMA_ADDR_OFFSET, val);
+  regs_set(regs, CSR_UDP_BIAS_DMA_ADDR_OFFSET, val);
 
   /* Control and activation functions */
   val = BUILD_UDP_CONTROL_DEMUX(params->csrdmux, params->enableBias,
                                 params->enableBatchNorm, params->enableRelu,
                                 params->enablePRelu, params->enableSQRelu,
                                 params->enableclippedRelu, params->csrmode);
-  reg_write(dev, CSR_UDP_CONTROL_DEMUX, val);
+  regs_set(regs, CSR_UDP_CONTROL_DEMUX, val);
 
   /* DMA and control registers */
-  reg_write(dev, CSR_WDMA_CSR, params->wdmaCSR);
-  reg_write(dev, CSR_WDMA_AXI_CSR, params->wdmaAXICSR);
-  reg_write(dev, CSR_RDMA_AXI_CSR, params->rdmaAXICSR);
-  reg_write(dev, CSR_WDMA_TRANSACTION_NUM, params->wdma_transaction_num);
+  regs_set(regs, CSR_WDMA_CSR, params->wdmaCSR);
+  regs_set(regs, CSR_WDMA_AXI_CSR, params->wdmaAXICSR);
+  regs_set(regs, CSR_RDMA_AXI_CSR, params->rdmaAXICSR);
+  regs_set(regs, CSR_WDMA_TRANSACTION_NUM, params->wdma_transaction_num);
 
   /* Interrupt configuration */
-  reg_write(dev, CSR_GLOBAL_INTERRUPT_EN, params->globalInterruptEn);
+  regs_set(regs, CSR_GLOBAL_INTERRUPT_EN, params->globalInterruptEn);
   val = BUILD_INTERRUPT_EN(params->doneInterruptEn, params->errorInterruptEn,
                            params->timeoutInterruptEn);
-  reg_write(dev, CSR_INTERRUPT_EN, val);
+  regs_set(regs, CSR_INTERRUPT_EN, val);
 
   /* Stall configuration */
   val = BUILD_STALL_COUNT(params->stallEn, params->stallCountValue);
-  reg_write(dev, CSR_STALL_COUNT, val);
-
-  DRM_INFO("UDP Core programming completed\n");
-  return 0;
+  regs_set(regs, CSR_STALL_COUNT, val);
 }
 
-int program_address_offsets(struct exslerate_device *dev,
-                            uint64_t input_base_addr, uint64_t filter_base_addr,
-                            uint64_t output_base_addr) {
-  struct exsl_write_config_args *params = &dev->conv_config;
-
-  DRM_INFO("Programming Address Offsets\n");
-
+static void pack_address_offsets(struct conv_layer_regs *regs,
+                                 const struct exsl_write_config_args *params,
+                                 uint64_t input_base_addr,
+                                 uint64_t filter_base_addr,
+                                 uint64_t output_base_addr) {
   /* Input activation addresses */
-  reg_write(dev, CSR_CC_IACT_BASE_ADDR_LOW,
-            (uint32_t)(input_base_addr & 0xFFFFFFFF));
-  reg_write(dev, CSR_CC_IACT_BASE_ADDR_HIGH, (uint32_t)(input_base_addr >> 32));
+  regs_set(regs, CSR_CC_IACT_BASE_ADDR_LOW,
+           (uint32_t)(input_base_addr & 0xFFFFFFFF));
+  regs_set(regs, CSR_CC_IACT_BASE_ADDR_HIGH, (uint32_t)(input_base_addr >> 32));
 
   /* Filter addresses */
-  reg_write(dev, CSR_CC_FILT_BASE_ADDR_LOW,
-            (uint32_t)(filter_base_addr & 0xFFFFFFFF));
-  reg_write(dev, CSR_CC_FILT_BASE_ADDR_HIGH,
-            (uint32_t)(filter_base_addr >> 32));
+  regs_set(regs, CSR_CC_FILT_BASE_ADDR_LOW,
+           (uint32_t)(filter_base_addr & 0xFFFFFFFF));
+  regs_set(regs, CSR_CC_FILT_BASE_ADDR_HIGH,
+           (uint32_t)(filter_base_addr >> 32));
 
   /* Lifetime addresses */
-  reg_write(dev, CSR_CC_LIFETIME_BASE_ADDR_LOW,
-            (uint32_t)(params->lifetimeBaseAddr & 0xFFFFFFFF));
-  reg_write(dev, CSR_CC_LIFETIME_BASE_ADDR_HIGH,
-            (uint32_t)(params->lifetimeBaseAddr >> 32));
+  regs_set(regs, CSR_CC_LIFETIME_BASE_ADDR_LOW,
+           (uint32_t)(params->lifetimeBaseAddr & 0xFFFFFFFF));
+  regs_set(regs, CSR_CC_LIFETIME_BASE_ADDR_HIGH,
+           (uint32_t)(params->lifetimeBaseAddr >> 32));
 
   /* UDP LUT and bias addresses */
-  reg_write(dev, CSR_UDP_LUT_BASE_ADDR, params->lutBaseAddr);
-  reg_write(dev, CSR_UDP_BIAS_BASE_ADDR, params->biasBaseAddr);
+  regs_set(regs, CSR_UDP_LUT_BASE_ADDR, params->lutBaseAddr);
+  regs_set(regs, CSR_UDP_BIAS_BASE_ADDR, (uint32_t)params->biasBaseAddr);
 
   /* BN bias addresses */
-  reg_write(dev, CSR_UDP_BN_BIAS_BASE_ADDR_LOW,
-            (uint32_t)(params->bnBiasBaseAddr & 0xFFFFFFFF));
-  reg_write(dev, CSR_UDP_BN_BIAS_BASE_ADDR_HIGH,
-            (uint32_t)(params->bnBiasBaseAddr >> 32));
+  regs_set(regs, CSR_UDP_BN_BIAS_BASE_ADDR_LOW,
+           (uint32_t)(params->bnBiasBaseAddr & 0xFFFFFFFF));
+  regs_set(regs, CSR_UDP_BN_BIAS_BASE_ADDR_HIGH,
+           (uint32_t)(params->bnBiasBaseAddr >> 32));
 
   /* BN weight addresses */
-  reg_write(dev, CSR_UDP_BN_WEIGHT_BASE_ADDR_LOW,
-            (uint32_t)(params->bnWeightBaseAddr & 0xFFFFFFFF));
-  reg_write(dev, CSR_UDP_BN_WEIGHT_BASE_ADDR_HIGH,
-            (uint32_t)(params->bnWeightBaseAddr >> 32));
+  regs_set(regs, CSR_UDP_BN_WEIGHT_BASE_ADDR_LOW,
+           (uint32_t)(params->bnWeightBaseAddr & 0xFFFFFFFF));
+  regs_set(regs, CSR_UDP_BN_WEIGHT_BASE_ADDR_HIGH,
+           (uint32_t)(params->bnWeightBaseAddr >> 32));
 
   /* Output base address */
-  reg_write(dev, CSR_AXI_OUTPUT_BASE_ADDR_LOW,
-            (uint32_t)(output_base_addr & 0xFFFFFFFF));
-  reg_write(dev, CSR_AXI_OUTPUT_BASE_ADDR_HIGH,
-            (uint32_t)(output_base_addr >> 32));
+  regs_set(regs, CSR_AXI_OUTPUT_BASE_ADDR_LOW,
+           (uint32_t)(output_base_addr & 0xFFFFFFFF));
+  regs_set(regs, CSR_AXI_OUTPUT_BASE_ADDR_HIGH,
+           (uint32_t)(output_base_addr >> 32));
+}
+
+/*
+ * Validate a layer config and pack it into the register image that
+ * program_conv_core() writes. With an interrupt wired up the completion
+ * interrupts are forced on, whatever the config asks for.
+ */
+int conv_layer_pack(struct exslerate_device *dev,
+                    const struct exsl_write_config_args *params,
+                    struct conv_layer_regs *regs) {
+  int ret;
+
+  ret = conv_layer_validate(params);
+  if (ret)
+    return ret;
+
+  memset(regs, 0, sizeof(*regs));
+  pack_convolution_core(regs, params);
+  pack_udp_core(regs, params);
+  pack_address_offsets(regs, params, params->ifBaseAddr, params->flBaseAddr,
+                       params->OutputBaseAddr);
+
+  if (dev->irq) {
+    regs_set(regs, CSR_GLOBAL_INTERRUPT_EN, 1);
+    regs_set(regs, CSR_INTERRUPT_EN, BUILD_INTERRUPT_EN(1, 1, 1));
+  }
 
-  DRM_INFO("Address Offsets programming completed\n");
   return 0;
 }
 
-int program_conv_core(struct exslerate_device *dev) {
+/* Low and high CSR of each address slot, high is 0 for 32-bit slots */
+static const struct {
+  uint16_t low, high;
+} conv_addr_csrs[CONV_NUM_ADDR_SLOTS] = {
+    [EXSL_RELOC_CONV_IFMAP] = {CSR_CC_IACT_BASE_ADDR_LOW,
+                               CSR_CC_IACT_BASE_ADDR_HIGH},
+    [EXSL_RELOC_CONV_FILTER] = {CSR_CC_FILT_BASE_ADDR_LOW,
+                                CSR_CC_FILT_BASE_ADDR_HIGH},
+    [EXSL_RELOC_CONV_LIFETIME] = {CSR_CC_LIFETIME_BASE_ADDR_LOW,
+                                  CSR_CC_LIFETIME_BASE_ADDR_HIGH},
+    [EXSL_RELOC_CONV_BIAS] = {CSR_UDP_BIAS_BASE_ADDR, 0},
+    [EXSL_RELOC_CONV_LUT] = {CSR_UDP_LUT_BASE_ADDR, 0},
+    [EXSL_RELOC_CONV_BN_BIAS] = {CSR_UDP_BN_BIAS_BASE_ADDR_LOW,
+                                 CSR_UDP_BN_BIAS_BASE_ADDR_HIGH},
+    [EXSL_RELOC_CONV_BN_WEIGHT] = {CSR_UDP_BN_WEIGHT_BASE_ADDR_LOW,
+                                   CSR_UDP_BN_WEIGHT_BASE_ADDR_HIGH},
+    [EXSL_RELOC_CONV_OUTPUT] = {CSR_AXI_OUTPUT_BASE_ADDR_LOW,
+                                CSR_AXI_OUTPUT_BASE_ADDR_HIGH},
+};
+
+/* Slots without a HIGH CSR, which only reach the low 4 GiB */
+bool conv_slot_is_32bit(uint32_t slot) {
+  return slot < CONV_NUM_ADDR_SLOTS && !conv_addr_csrs[slot].high;
+}
 
-  DRM_INFO("Starting Conv Core Programming\n");
+/* Patch the address of one relocated slot into a packed layer image */
+int conv_layer_set_addr(struct conv_layer_regs *regs, uint32_t slot,
+                        uint64_t addr) {
+  if (slot >= CONV_NUM_ADDR_SLOTS)
+    return -EINVAL;
 
-  /* For now, just return success - uncomment individual parts as needed */
-  /*
-  ret = program_convolution_core(dev);
-  if (ret) {
-          DRM_ERROR("Failed to program convolution core: %d\n", ret);
-          return ret;
+  if (!conv_addr_csrs[slot].high && upper_32_bits(addr)) {
+    DRM_ERROR("Address 0x%llx does not fit conv address slot %u\n", addr,
+              slot);
+    return -EINVAL;
   }
 
-  ret = program_udp_core(dev);
-  if (ret) {
-          DRM_ERROR("Failed to program UDP core: %d\n", ret);
-          return ret;
-  }
+  regs_set(regs, conv_addr_csrs[slot].low, lower_32_bits(addr));
+  if (conv_addr_csrs[slot].high)
+    regs_set(regs, conv_addr_csrs[slot].high, upper_32_bits(addr));
+  return 0;
+}
 
-  ret = program_address_offsets(dev, dev->conv_config.ifBaseAddr,
-                                dev->conv_config.flBaseAddr,
-                                dev->conv_config.OutputBaseAddr);
-  if (ret) {
-          DRM_ERROR("Failed to program address offsets: %d\n", ret);
-          return ret;
+/*
+ * WDMA_CSR carries the WDMA go bit, so it is rewritten for every layer even
+ * when its value matches the shadow.
+ */
+static bool conv_csr_volatile(uint32_t offset) {
+  return offset == CSR_WDMA_CSR;
+}
+
+/*
+ * Write a packed layer image to the conv core. Only CSRs that differ from
+ * the last programmed values are written, unordered; the writel() in
+ * conv_core_start() orders them all before the kick.
+ */
+int program_conv_core(struct exslerate_device *dev,
+                      const struct conv_layer_regs *regs) {
+  uint32_t offset, val, written = 0;
+  size_t i;
+
+  for (i = 0; i < ARRAY_SIZE(conv_layer_csrs); i++) {
+    offset = conv_layer_csrs[i];
+    val = regs->val[offset >> 2];
+
+    if (conv_csr_volatile(offset)) {
+      reg_write_relaxed(dev, offset, val);
+      written++;
+    } else if (reg_write_cached(dev, offset, val)) {
+      written++;
+    }
   }
-  */
 
-  DRM_INFO("Conv Core Programming completed successfully\n");
+  DRM_DEBUG("Programmed %u of %zu conv core CSRs\n", written,
+            ARRAY_SIZE(conv_layer_csrs));
   return 0;
 }
 
-int program_gemm_core(struct exslerate_device *dev) {
-  DRM_INFO("GEMM Core programming - not implemented yet\n");
-  return 0;
+/* Force a full reprogram, e.g. after the core may have lost its state */
+void conv_core_invalidate(struct exslerate_device *dev) {
+  reg_shadow_invalidate(dev, 0, sizeof(struct conv_layer_regs));
+}
+
+/* Kick the conv core with the currently programmed layer */
+void conv_core_start(struct exslerate_device *dev) {
+  reg_write(dev, CSR_CONV_CORE_EN, 1);
+}
+
+/* Drop the enable so the next kick is seen as a fresh start */
+void conv_core_stop(struct exslerate_device *dev) {
+  reg_write(dev, CSR_CONV_CORE_EN, 0);
+}
+
+uint32_t conv_core_status(struct exslerate_device *dev) {
+  return reg_read(dev, CSR_CONV_CORE_STATUS);
 }
 
 int debug_conv_core(struct exslerate_device *dev) {
@@ -69,6 +69,7 @@
 #define CSR_RDMA_AXI_CSR 0x000000CC             /* RDMA AXI Control */
 #define CSR_CONV_CORE_EN 0x000000D0             /* Conv Core Enable */
 #define CSR_WDMA_TRANSACTION_NUM 0x000000D4     /* WDMA Transaction Number */
+#define CSR_CONV_CORE_STATUS 0x000000D8         /* Conv Core Status */
 
 /* High Address Registers */
 #define CSR_CC_IACT_BASE_ADDR_HIGH                                             \
@@ -190,6 +191,15 @@
 #define SET_INT_ERROR_EN(val) SET_BITS(val, INT_ERROR_EN_SHIFT, 1)
 #define SET_INT_TIMEOUT_EN(val) SET_BITS(val, INT_TIMEOUT_EN_SHIFT, 1)
 
+/* Conv core status register bit fields (same layout as CSR_INTERRUPT_EN) */
+#define STATUS_DONE_SHIFT 0
+#define STATUS_ERROR_SHIFT 1
+#define STATUS_TIMEOUT_SHIFT 2
+#define STATUS_DONE BIT(STATUS_DONE_SHIFT)
+#define STATUS_ERROR BIT(STATUS_ERROR_SHIFT)
+#define STATUS_TIMEOUT BIT(STATUS_TIMEOUT_SHIFT)
+#define STATUS_COMPLETE_MASK (STATUS_DONE | STATUS_ERROR | STATUS_TIMEOUT)
+
 /* Multi-field register builders */
 #define BUILD_CC_MAPPING(pooling) SET_CC_POOLING(pooling)
 
@@ -226,11 +236,28 @@
   (SET_INT_DONE_EN(done_en) | SET_INT_ERROR_EN(error_en) |                     \
    SET_INT_TIMEOUT_EN(timeout_en))
 
+/* Final CSR values of one conv layer, indexed by CSR offset / 4 */
+#define CONV_LAYER_NUM_REGS ((CSR_INTERRUPT_EN >> 2) + 1)
+
+struct conv_layer_regs {
+  uint32_t val[CONV_LAYER_NUM_REGS];
+};
+
+/* Relocatable address slots, indexed by EXSL_RELOC_CONV_* */
+#define CONV_NUM_ADDR_SLOTS (EXSL_RELOC_CONV_OUTPUT + 1)
+
 /* Function declarations */
-int program_convolution_core(struct exslerate_device *dev);
-int program_udp_core(struct exslerate_device *dev);
-int program_address_offsets(struct exslerate_device *dev,
-                            uint64_t input_base_addr, uint64_t filter_base_addr,
-                            uint64_t output_base_addr);
+int conv_layer_pack(struct exslerate_device *dev,
+                    const struct exsl_write_config_args *params,
+                    struct conv_layer_regs *regs);
+bool conv_slot_is_32bit(uint32_t slot);
+int conv_layer_set_addr(struct conv_layer_regs *regs, uint32_t slot,
+                        uint64_t addr);
+int program_conv_core(struct exslerate_device *dev,
+                      const struct conv_layer_regs *regs);
+void conv_core_invalidate(struct exslerate_device *dev);
+void conv_core_start(struct exslerate_device *dev);
+void conv_core_stop(struct exslerate_device *dev);
+uint32_t conv_core_status(struct exslerate_device *dev);
 
 #endif /* _CONV_ENGINE_H_ */
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <drm/drm_drv.h>
 #include <drm/drm_print.h>
 #include <linux/clk.h>
+#include <linux/dma-mapping.h>
 #include <linux/init.h>
 #include <linux/io.h>
 #include <linux/kernel.h>
@@ -13,6 +14,7 @@
 #include <linux/of_device.h>
 #include <linux/of_reserved_mem.h>
 #include <linux/platform_device.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 
 /* Device tree matching table */
@@ -104,6 +106,99 @@ static const struct of_device_id exslerate_of_match[] = {
 
 MODULE_DEVICE_TABLE(of, exslerate_of_match);
 
+static struct reserved_mem *exslerate_lookup_region(struct device *dev,
+                                                   int32_t index) {
+  struct reserved_mem *rmem;
+  struct device_node *np;
+
+  np = of_parse_phandle(dev->of_node, "memory-region", index);
+  if (!np)
+    return NULL;
+
+  rmem = of_reserved_mem_lookup(np);
+  of_node_put(np);
+  return rmem;
+}
+
+static void exslerate_dma32_dev_release(struct device *dev) {
+  kfree(dev);
+}
+
+/*
+ * The UDP bias and LUT base CSRs are 32-bit, so EXSL_BO_FLAG_DMA32 BOs need
+ * memory below 4 GiB. That is the reserved pool when it ends there, else an
+ * optional second memory-region, bound to a child device of its own.
+ */
+static int32_t exslerate_pool_init(struct exslerate_device *exsl_dev) {
+  struct device *dev = &exsl_dev->pdev->dev;
+  struct reserved_mem *rmem;
+  struct device *dma32_dev;
+  int32_t ret;
+
+  rmem = exslerate_lookup_region(dev, 0);
+  if (!rmem)
+    return -ENODEV;
+
+  exsl_dev->pool_end = rmem->base + rmem->size;
+  if (exsl_dev->pool_end - 1 > dma_get_mask(dev)) {
+    dev_err(dev, "Reserved pool %pa+%pa is out of reach of the AXI master\n",
+            &rmem->base, &rmem->size);
+    return -EINVAL;
+  }
+
+  if (exsl_dev->pool_end <= SZ_4G) {
+    exsl_dev->dma32_dev = dev;
+    return 0;
+  }
+
+  rmem = exslerate_lookup_region(dev, 1);
+  if (!rmem) {
+    dev_warn(dev, "Reserved pool ends above 4 GiB without a low "
+                  "memory-region, EXSL_BO_FLAG_DMA32 disabled\n");
+    return 0;
+  }
+
+  if (rmem->base + rmem->size > SZ_4G) {
+    dev_err(dev, "Low memory-region %pa+%pa ends above 4 GiB\n", &rmem->base,
+            &rmem->size);
+    return -EINVAL;
+  }
+
+  dma32_dev = kzalloc(sizeof(*dma32_dev), GFP_KERNEL);
+  if (!dma32_dev)
+    return -ENOMEM;
+
+  device_initialize(dma32_dev);
+  dma32_dev->parent = dev;
+  dma32_dev->release = exslerate_dma32_dev_release;
+  dma32_dev->coherent_dma_mask = DMA_BIT_MASK(32);
+  dma32_dev->dma_mask = &dma32_dev->coherent_dma_mask;
+  dev_set_name(dma32_dev, "%s:dma32", dev_name(dev));
+
+  ret = of_reserved_mem_device_init_by_idx(dma32_dev, dev->of_node, 1);
+  if (ret) {
+    dev_err(dev, "Failed to initialize low memory-region: %d\n", ret);
+    put_device(dma32_dev);
+    return ret;
+  }
+
+  exsl_dev->dma32_dev = dma32_dev;
+  dev_info(dev, "Low memory-region %pa+%pa for EXSL_BO_FLAG_DMA32 BOs\n",
+           &rmem->base, &rmem->size);
+  return 0;
+}
+
+static void exslerate_pool_fini(struct exslerate_device *exsl_dev) {
+  struct device *dma32_dev = exsl_dev->dma32_dev;
+
+  exsl_dev->dma32_dev = NULL;
+  if (!dma32_dev || dma32_dev == &exsl_dev->pdev->dev)
+    return;
+
+  of_reserved_mem_device_release(dma32_dev);
+  put_device(dma32_dev);
+}
+
 static int32_t exslerate_remove(struct platform_device *pdev) {
   struct exslerate_device *exsl_dev = platform_get_drvdata(pdev);
 
@@ -119,16 +214,42 @@ static int32_t exslerate_remove(struct platform_device *pdev) {
   }
 
   /* Release reserved memory */
+  exslerate_pool_fini(exsl_dev);
   of_reserved_mem_device_release(&pdev->dev);
 
   dev_info(&pdev->dev, "ExSLerate driver removed successfully\n");
   return 0;
 }
+
+/*
+ * The UDP bias and LUT base CSRs are 32-bit and those tables come from the
+ * reserved pool, so the pool has to end below 4 GiB.
+ */
+static int32_t exslerate_check_pool(struct device *dev) {
+  struct reserved_mem *rmem;
+  struct device_node *np;
+
+  np = of_parse_phandle(dev->of_node, "memory-region", 0);
+  if (!np)
+    return 0;
+
+  rmem = of_reserved_mem_lookup(np);
+  of_node_put(np);
+  if (rmem && rmem->base + rmem->size > SZ_4G) {
+    dev_err(dev, "Reserved pool %pa+%pa ends above 4 GiB\n", &rmem->base,
+            &rmem->size);
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
 static int32_t exslerate_probe(struct platform_device *pdev) {
   int32_t err = 0;
   struct resource *res;
   struct exslerate_device *exsl_dev;
   struct device *dev = &pdev->dev;
+  uint32_t addr_width = 32;
 
   dev_info(dev, "Probing ExSLerate device\n");
 
@@ -166,6 +287,32 @@ static int32_t exslerate_probe(struct platform_device *pdev) {
     return PTR_ERR(exsl_dev->base);
   }
 
+  /* Get completion interrupt (optional, polled when absent) */
+  exsl_dev->irq = platform_get_irq_optional(pdev, 0);
+  if (exsl_dev->irq == -EPROBE_DEFER)
+    return -EPROBE_DEFER;
+  if (exsl_dev->irq < 0) {
+    dev_warn(dev, "No interrupt found, polling conv core status\n");
+    exsl_dev->irq = 0;
+  }
+
+  /*
+   * How many address bits reach DDR is up to the AXI master width of the
+   * bitstream. 40 bits lets the reserved pool, and BOs outside it such as
+   * cached BOs and user pages, sit in the ZynqMP DDR bank above 4 GiB.
+   */
+  of_property_read_u32(dev->of_node, "xlnx,addr-width", &addr_width);
+  if (addr_width < 32 || addr_width > 64) {
+    dev_err(dev, "Invalid xlnx,addr-width %u\n", addr_width);
+    return -EINVAL;
+  }
+
+  err = dma_set_mask_and_coherent(dev, DMA_BIT_MASK(addr_width));
+  if (err) {
+    dev_err(dev, "Failed to set %u-bit DMA mask: %d\n", addr_width, err);
+    return err;
+  }
+
   /* Initialize reserved memory for DMA */
   err = of_reserved_mem_device_init(dev);
   if (err) {
@@ -174,6 +321,10 @@ static int32_t exslerate_probe(struct platform_device *pdev) {
   }
   dev_info(dev, "Reserved memory initialized for DMA allocations\n");
 
+  err = exslerate_pool_init(exsl_dev);
+  if (err)
+    goto err_release_mem;
+
   /* Get clock resource (optional) */
   exsl_dev->axi_clk = devm_clk_get(dev, "axi_aclk");
   if (IS_ERR(exsl_dev->axi_clk)) {
@@ -189,7 +340,6 @@ static int32_t exslerate_probe(struct platform_device *pdev) {
   }
 
   /* Initialize device parameters with defaults */
-  memset(&exsl_dev->conv_config, 0, sizeof(exsl_dev->conv_config));
   exsl_dev->core_enabled = 0;
 
   /* Register DRM device */
@@ -206,6 +356,7 @@ err_clk_disable:
   if (exsl_dev->axi_clk)
     clk_disable_unprepare(exsl_dev->axi_clk);
 err_release_mem:
+  exslerate_pool_fini(exsl_dev);
   of_reserved_mem_device_release(dev);
   return err;
 }
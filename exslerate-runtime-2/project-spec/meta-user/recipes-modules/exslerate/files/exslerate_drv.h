@@ -3,37 +3,115 @@
 
 #include <drm/drm_drv.h>
 #include <drm/drm_print.h>
+#include <drm/gpu_scheduler.h>
+#include <linux/bitmap.h>
 #include <linux/cdev.h>
 #include <linux/clk.h>
 #include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/dma-fence.h>
 #include <linux/io.h>
 #include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
+#include <linux/xarray.h>
 
+#include "exslerate_gem.h"
+#include "exslerate_heap.h"
 #include "exslerate_ioctl.h"
+#include "exslerate_residency.h"
 
 #define DRIVER_NAME "exslerate"
 #define WDMA_OFFSET 0x30040000
 #define DDR_INIT 0x30000000
 
+/* CSR space covered by the register shadow */
+#define EXSLERATE_CSR_SPACE 0x400
+#define EXSLERATE_CSR_WORDS (EXSLERATE_CSR_SPACE >> 2)
+
 /* Task information for ExSLerate operations */
 struct exslerate_task {
+  struct drm_sched_job base;
   struct kref ref;
+  uint32_t type; /* EXSL_CMD_SUBMIT_* */
   uint32_t num_addresses;
   struct exslerate_device *exsl_dev;
   struct exslerate_mem_handle *address_list;
   struct drm_file *file;
+
+  /* BOs referenced by the job, kept alive until it retires */
+  struct drm_gem_object **bos;
+  uint32_t bo_count;
+  unsigned long *bo_reads; /* BOs the relocations only read, NULL if none */
+
+  /* Fences the job waits on before run_job, consumed in index order */
+  struct xarray deps;
+  unsigned long last_dep;
+
+  /* Hardware fence signalled when the core reports completion */
+  struct dma_fence *irq_fence;
+  uint32_t hw_status; /* Status register value the job completed with */
+  ktime_t ready;      /* When the scheduler handed the job to the driver */
+
+  /* Packed layers the job runs back to back, and the one on the core */
+  struct exslerate_layer_desc **descs;
+  uint32_t desc_count;
+  uint32_t layer;
+  uint32_t core_type; /* Core every layer of the job runs on */
+
+  /* Address slots patched into the layers as they run, sorted by layer */
+  struct exsl_reloc *relocs;
+  uint32_t reloc_count;
+  uint32_t next_reloc; /* First reloc of the layer on the core */
 };
 
+static inline struct exslerate_task *
+to_exsl_task(struct drm_sched_job *sched_job) {
+  return container_of(sched_job, struct exslerate_task, base);
+}
+
 /* Memory handle for DMA operations */
 struct exslerate_mem_handle {
   uint32_t handle;
   uint64_t offset;
 };
 
+/*
+ * Cores with their own job queue, indexed by core type. Only the conv core
+ * has a register map; EXSL_GEMM_CORE gets its ring along with one.
+ */
+#define EXSLERATE_NUM_ENGINES 1
+
+struct exslerate_engine {
+  struct exslerate_device *exsl_dev;
+  uint32_t core_type;
+  const char *name;
+
+  struct drm_gpu_scheduler sched;
+  uint64_t fence_context;
+  uint32_t emit_seqno;
+
+  struct mutex hw_lock; /* Protects task, next_* and the core's CSRs */
+  struct exslerate_task *task;      /* Job currently on the core */
+  struct exslerate_task *next_task; /* Job to kick once task completes */
+  /* First layer of next_task, relocated while task runs, or an ERR_PTR */
+  const struct exslerate_layer_desc *next_desc;
+  struct exslerate_layer_desc *next_image; /* Backs next_desc if relocated */
+  ktime_t last_done;                /* When the core last went idle */
+  struct work_struct done_work;     /* Status polling when there is no IRQ */
+  uint32_t irq_status;
+  ktime_t irq_time; /* When the hard IRQ saw the completion */
+
+  /* Utilisation, updated as each layer completes */
+  ktime_t layer_start;
+  uint64_t busy_ns;
+  uint64_t job_count;
+};
+
 struct exslerate_device {
   struct platform_device *pdev;
   void __iomem *base;
@@ -41,10 +119,35 @@ struct exslerate_device {
   void __iomem *wdma_base;
   struct clk *axi_clk;
   struct drm_device *drm;
-  struct exslerate_task *task;
-  struct exsl_write_config_args conv_config;
   uint32_t core_enabled;
   spinlock_t status_lock;
+
+  /* Job schedulers, one per core */
+  struct exslerate_engine engines[EXSLERATE_NUM_ENGINES];
+  spinlock_t job_lock; /* Fence lock, protects fence emission */
+
+  /* Last values written to the CSRs, per register valid bit */
+  uint32_t csr_shadow[EXSLERATE_CSR_WORDS];
+  DECLARE_BITMAP(csr_shadow_valid, EXSLERATE_CSR_WORDS);
+
+  /*
+   * End of the reserved pool, and the device EXSL_BO_FLAG_DMA32 BOs are
+   * allocated from: the pool's own below 4 GiB, else one bound to the low
+   * memory-region. NULL when there is no memory for them.
+   */
+  phys_addr_t pool_end;
+  struct device *dma32_dev;
+
+  struct exslerate_heap heap; /* Backs EXSL_BO_DEV_HEAP and EXSL_BO_DEV */
+  struct exslerate_bo_cache bo_cache; /* Freed CMA buffers */
+  struct exslerate_residency residency; /* Evictable BOs */
+
+  /* Completion interrupt shared by the cores, 0 if not wired in the DT */
+  int32_t irq;
+  unsigned long irq_pending; /* Engines the IRQ thread has to retire */
+  uint32_t last_error_status;
+  uint64_t error_count;
+  uint64_t timeout_count;
   struct cdev cdev;
   dev_t devt;
   struct class *class;
@@ -57,13 +160,38 @@ static inline void reg_write(struct exslerate_device *dev, uint32_t offset,
   writel(value, dev->base + offset);
 }
 
+/* Unordered write, for CSR batches that are followed by a reg_write() kick */
+static inline void reg_write_relaxed(struct exslerate_device *dev,
+                                     uint32_t offset, uint32_t value) {
+  writel_relaxed(value, dev->base + offset);
+}
+
+/*
+ * Relaxed write of a CSR that is skipped when the shadow shows the register
+ * already holds @value. Returns true if the register was written.
+ */
+static inline bool reg_write_cached(struct exslerate_device *dev,
+                                    uint32_t offset, uint32_t value) {
+  uint32_t idx = offset >> 2;
+
+  if (test_bit(idx, dev->csr_shadow_valid) && dev->csr_shadow[idx] == value)
+    return false;
+
+  reg_write_relaxed(dev, offset, value);
+  dev->csr_shadow[idx] = value;
+  set_bit(idx, dev->csr_shadow_valid);
+  return true;
+}
+
+/* Forget the shadow of [@offset, @offset + @size), forcing a full rewrite */
+static inline void reg_shadow_invalidate(struct exslerate_device *dev,
+                                         uint32_t offset, uint32_t size) {
+  bitmap_clear(dev->csr_shadow_valid, offset >> 2, size >> 2);
+}
+
 static inline uint32_t reg_read(struct exslerate_device *dev, uint32_t offset) {
   uint32_t value = readl(dev->base + offset);
   return value;
 }
 
-/* Engine function declarations */
-int program_conv_core(struct exslerate_device *dev);
-int program_gemm_core(struct exslerate_device *dev);
-
 #endif /* _EXSLERATE_DRV_H_ */
\ No newline at end of file
@@ -1,146 +1,1484 @@
 /* exslerate_gem.c - ExSLerate GEM buffer management */
 #include <drm/drm.h>
+#include <drm/drm_auth.h>
 #include <drm/drm_device.h>
 #include <drm/drm_drv.h>
 #include <drm/drm_file.h>
 #include <drm/drm_gem.h>
+#include <drm/drm_debugfs.h>
+#include <drm/drm_device.h>
 #include <drm/drm_gem_cma_helper.h>
 #include <drm/drm_ioctl.h>
+#include <drm/drm_managed.h>
+#include <drm/drm_prime.h>
+#include <drm/drm_syncobj.h>
+#include <linux/capability.h>
+#include <linux/dma-buf-map.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-resv.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
 
+#include "conv_engine.h"
 #include "exslerate_drv.h"
 #include "exslerate_gem.h"
+#include "exslerate_heap.h"
 #include "exslerate_ioctl.h"
+#include "exslerate_sched.h"
+#include "exslerate_slab.h"
 
 #define EXSLERATE_BO_SHARE 1
 #define EXSLERATE_BO_CMD 2
 #define EXSLERATE_BO_DMA 3
 #define EXSLERATE_BO_DEV 4
 
-#define EXSLERATE_INVALID_ADDR (0)
+static uint32_t exslerate_bo_cache_mb = 64;
+module_param_named(bo_cache_mb, exslerate_bo_cache_mb, uint, 0644);
+MODULE_PARM_DESC(bo_cache_mb,
+                 "Freed CMA buffers kept for reuse, in MiB (default 64, "
+                 "0 disables)");
+
+/* Backing store of a freed CMA BO */
+struct exslerate_bo_cache_entry {
+  struct list_head bucket_link;
+  struct list_head lru_link;
+  void *vaddr;
+  dma_addr_t paddr;
+  size_t size;
+  struct dma_fence *fence; /* Last device write, NULL if there was none */
+};
+
+static uint32_t exslerate_bo_cache_bucket(size_t size) {
+  return min_t(uint32_t, ilog2(size >> PAGE_SHIFT),
+               EXSLERATE_BO_CACHE_BUCKETS - 1);
+}
+
+static bool exslerate_bo_cache_idle(struct exslerate_bo_cache_entry *entry) {
+  return !entry->fence || dma_fence_is_signaled(entry->fence);
+}
+
+/* Called with the cache lock held, on idle entries only */
+static void exslerate_bo_cache_evict(struct exslerate_bo_cache *cache,
+                                     struct exslerate_bo_cache_entry *entry) {
+  list_del(&entry->bucket_link);
+  list_del(&entry->lru_link);
+  cache->size -= entry->size;
+  cache->count--;
+
+  dma_fence_put(entry->fence);
+  dma_free_wc(cache->dev, entry->size, entry->vaddr, entry->paddr);
+  kfree(entry);
+}
+
+/*
+ * Give idle buffers back to the pool, oldest first, until @size bytes are
+ * freed. Called with the cache lock held.
+ */
+static size_t exslerate_bo_cache_trim_locked(struct exslerate_bo_cache *cache,
+                                             size_t size) {
+  struct exslerate_bo_cache_entry *entry, *tmp;
+  size_t freed = 0;
+
+  list_for_each_entry_safe(entry, tmp, &cache->lru, lru_link) {
+    if (freed >= size)
+      break;
+    if (!exslerate_bo_cache_idle(entry))
+      continue;
+
+    freed += entry->size;
+    exslerate_bo_cache_evict(cache, entry);
+  }
+
+  return freed;
+}
+
+/*
+ * Keep the backing store of a CMA BO that is being freed. Returns false if
+ * it does not fit under the cap and has to be released.
+ */
+static bool exslerate_bo_cache_put(struct exslerate_bo_cache *cache,
+                                   struct drm_gem_cma_object *cma) {
+  size_t cap = (size_t)READ_ONCE(exslerate_bo_cache_mb) << 20;
+  struct exslerate_bo_cache_entry *entry;
+  size_t size = cma->base.size;
+
+  if (size > cap || cma->base.import_attach || !cma->vaddr ||
+      cma->map_noncoherent)
+    return false;
+
+  entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+  if (!entry)
+    return false;
+
+  entry->vaddr = cma->vaddr;
+  entry->paddr = cma->paddr;
+  entry->size = size;
+  entry->fence = dma_resv_get_excl_unlocked(cma->base.resv);
+
+  mutex_lock(&cache->lock);
+
+  /*
+   * Make room by dropping the oldest idle buffers. Busy ones are skipped
+   * rather than waited for, so a full cache of busy buffers lets this one go.
+   */
+  if (cache->size + size > cap)
+    exslerate_bo_cache_trim_locked(cache, cache->size + size - cap);
+  if (cache->size + size > cap) {
+    mutex_unlock(&cache->lock);
+    dma_fence_put(entry->fence);
+    kfree(entry);
+    return false;
+  }
+
+  list_add_tail(&entry->bucket_link,
+                &cache->buckets[exslerate_bo_cache_bucket(size)]);
+  list_add_tail(&entry->lru_link, &cache->lru);
+  cache->size += size;
+  cache->count++;
+  mutex_unlock(&cache->lock);
+
+  return true;
+}
+
+/*
+ * Take an idle cached buffer of exactly @size. Reused buffers are cleared,
+ * like fresh ones from the pool, since they may come from another client.
+ */
+static struct exslerate_bo_cache_entry *
+exslerate_bo_cache_get(struct exslerate_bo_cache *cache, size_t size) {
+  struct exslerate_bo_cache_entry *entry, *found = NULL;
+
+  mutex_lock(&cache->lock);
+  list_for_each_entry(entry, &cache->buckets[exslerate_bo_cache_bucket(size)],
+                      bucket_link) {
+    if (entry->size == size && exslerate_bo_cache_idle(entry)) {
+      found = entry;
+      break;
+    }
+  }
+
+  if (found) {
+    list_del(&found->bucket_link);
+    list_del(&found->lru_link);
+    cache->size -= size;
+    cache->count--;
+    cache->hits++;
+  } else {
+    cache->misses++;
+  }
+  mutex_unlock(&cache->lock);
+
+  if (found) {
+    dma_fence_put(found->fence);
+    memset(found->vaddr, 0, size);
+  }
+
+  return found;
+}
+
+static unsigned long
+exslerate_bo_cache_count(struct shrinker *shrinker,
+                         struct shrink_control *sc) {
+  struct exslerate_bo_cache *cache =
+      container_of(shrinker, struct exslerate_bo_cache, shrinker);
+
+  return READ_ONCE(cache->size) >> PAGE_SHIFT;
+}
+
+/* Make room in the pool for an allocation that failed */
+size_t exslerate_bo_cache_trim(struct exslerate_bo_cache *cache,
+                               size_t size) {
+  size_t freed;
+
+  mutex_lock(&cache->lock);
+  freed = exslerate_bo_cache_trim_locked(cache, size);
+  mutex_unlock(&cache->lock);
+
+  return freed;
+}
+
+static unsigned long exslerate_bo_cache_scan(struct shrinker *shrinker,
+                                             struct shrink_control *sc) {
+  struct exslerate_bo_cache *cache =
+      container_of(shrinker, struct exslerate_bo_cache, shrinker);
+  size_t freed;
+
+  if (!mutex_trylock(&cache->lock))
+    return SHRINK_STOP;
+
+  freed = exslerate_bo_cache_trim_locked(cache, sc->nr_to_scan << PAGE_SHIFT);
+  mutex_unlock(&cache->lock);
+
+  return freed >> PAGE_SHIFT;
+}
+
+/* Runs once the last BO is gone, with the DRM device */
+static void exslerate_bo_cache_fini(struct drm_device *drm, void *data) {
+  struct exslerate_bo_cache *cache = data;
+  struct exslerate_bo_cache_entry *entry, *tmp;
+
+  unregister_shrinker(&cache->shrinker);
+
+  /* Nothing else can reach the cache now, so wait for stragglers unlocked */
+  list_for_each_entry(entry, &cache->lru, lru_link) {
+    if (entry->fence)
+      dma_fence_wait(entry->fence, false);
+  }
+
+  mutex_lock(&cache->lock);
+  list_for_each_entry_safe(entry, tmp, &cache->lru, lru_link)
+      exslerate_bo_cache_evict(cache, entry);
+  mutex_unlock(&cache->lock);
+
+  mutex_destroy(&cache->lock);
+}
+
+static int32_t exslerate_bo_cache_init(struct exslerate_device *exsl_dev) {
+  struct exslerate_bo_cache *cache = &exsl_dev->bo_cache;
+  uint32_t i;
+  int32_t ret;
+
+  cache->dev = &exsl_dev->pdev->dev;
+  mutex_init(&cache->lock);
+  INIT_LIST_HEAD(&cache->lru);
+  for (i = 0; i < EXSLERATE_BO_CACHE_BUCKETS; i++)
+    INIT_LIST_HEAD(&cache->buckets[i]);
+
+  cache->shrinker.count_objects = exslerate_bo_cache_count;
+  cache->shrinker.scan_objects = exslerate_bo_cache_scan;
+  cache->shrinker.seeks = DEFAULT_SEEKS;
+  ret = register_shrinker(&cache->shrinker);
+  if (ret) {
+    DRM_ERROR("Failed to register BO cache shrinker: %d\n", ret);
+    mutex_destroy(&cache->lock);
+    return ret;
+  }
+
+  return drmm_add_action_or_reset(exsl_dev->drm, exslerate_bo_cache_fini,
+                                  cache);
+}
+
+static void exslerate_gem_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_device *exsl_dev = gobj->dev->dev_private;
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  if (abo->mem.pages) {
+    u32 i;
+    for (i = 0; i < abo->mem.nr_pages; i++) {
+      if (abo->mem.pages[i])
+        put_page(abo->mem.pages[i]);
+    }
+    kvfree(abo->mem.pages);
+  }
+
+  /* Hand the buffer to the cache, the helper then only frees the object */
+  if (exslerate_bo_cache_put(&exsl_dev->bo_cache, &abo->base))
+    abo->base.vaddr = NULL;
+
+  /* The helper would free a cached BO with the wrong DMA direction */
+  if (abo->base.map_noncoherent && abo->base.vaddr) {
+    dma_free_noncoherent(gobj->dev->dev, gobj->size, abo->base.vaddr,
+                         abo->base.paddr, DMA_BIDIRECTIONAL);
+    abo->base.vaddr = NULL;
+  }
+
+  mutex_destroy(&abo->lock);
+  drm_gem_cma_free_object(gobj);
+}
+
+static void exslerate_gem_print_info(struct drm_printer *p, unsigned int indent,
+                                     const struct drm_gem_object *gobj) {
+  drm_gem_cma_print_info(p, indent, gobj);
+}
+
+/* Heap BOs share the heap's coherent allocation, so mmap works the same */
+static int exslerate_gem_mmap(struct drm_gem_object *gobj,
+                              struct vm_area_struct *vma) {
+  return drm_gem_cma_mmap(&to_exsl_obj(gobj)->base, vma);
+}
+
+static int exslerate_gem_vmap(struct drm_gem_object *gobj,
+                              struct dma_buf_map *map) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  if (!abo->mem.kva)
+    return -ENOMEM;
+
+  dma_buf_map_set_vaddr(map, abo->mem.kva);
+  return 0;
+}
+
+/*
+ * Pool memory is no-map and has no struct pages, so the table only carries
+ * a DMA address, mapped for the importing device as a resource. Importers
+ * that need pages (sg_page(), e.g. shmem-backed DRM drivers) cannot use it.
+ * The cores sit behind no IOMMU or DMA offset, so our device address is
+ * the physical address.
+ */
+static struct sg_table *
+exslerate_gem_map_dma_buf(struct dma_buf_attachment *attach,
+                          enum dma_data_direction dir) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(attach->dmabuf->priv);
+  struct sg_table *sgt;
+  dma_addr_t addr;
+  int32_t ret;
+
+  sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+  if (!sgt)
+    return ERR_PTR(-ENOMEM);
+
+  ret = sg_alloc_table(sgt, 1, GFP_KERNEL);
+  if (ret)
+    goto free_sgt;
+
+  addr = dma_map_resource(attach->dev, abo->mem.dev_addr, abo->mem.size, dir,
+                          DMA_ATTR_SKIP_CPU_SYNC);
+  if (dma_mapping_error(attach->dev, addr)) {
+    ret = -ENOMEM;
+    goto free_table;
+  }
+
+  sg_dma_address(sgt->sgl) = addr;
+  sg_dma_len(sgt->sgl) = abo->mem.size;
+
+  return sgt;
+
+free_table:
+  sg_free_table(sgt);
+free_sgt:
+  kfree(sgt);
+  return ERR_PTR(ret);
+}
+
+static void exslerate_gem_unmap_dma_buf(struct dma_buf_attachment *attach,
+                                        struct sg_table *sgt,
+                                        enum dma_data_direction dir) {
+  dma_unmap_resource(attach->dev, sg_dma_address(sgt->sgl),
+                     sg_dma_len(sgt->sgl), dir, DMA_ATTR_SKIP_CPU_SYNC);
+  sg_free_table(sgt);
+  kfree(sgt);
+}
+
+static const struct dma_buf_ops exslerate_dmabuf_ops = {
+    .cache_sgt_mapping = true,
+    .attach = drm_gem_map_attach,
+    .detach = drm_gem_map_detach,
+    .map_dma_buf = exslerate_gem_map_dma_buf,
+    .unmap_dma_buf = exslerate_gem_unmap_dma_buf,
+    .release = drm_gem_dmabuf_release,
+    .mmap = drm_gem_dmabuf_mmap,
+    .vmap = drm_gem_dmabuf_vmap,
+    .vunmap = drm_gem_dmabuf_vunmap,
+};
+
+static struct dma_buf *exslerate_gem_prime_export(struct drm_gem_object *gobj,
+                                                  int flags) {
+  DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+
+  /* Importers could write pages that were pinned without write access */
+  if (to_exsl_obj(gobj)->flags & EXSL_BO_FLAG_READ_ONLY)
+    return ERR_PTR(-EPERM);
+
+  exp_info.ops = &exslerate_dmabuf_ops;
+  exp_info.size = gobj->size;
+  exp_info.flags = flags;
+  exp_info.priv = gobj;
+  exp_info.resv = gobj->resv;
+
+  return drm_gem_dmabuf_export(gobj->dev, &exp_info);
+}
+
+static const struct drm_gem_object_funcs exslerate_gem_cma_funcs = {
+    .free = exslerate_gem_free_object,
+    .print_info = exslerate_gem_print_info,
+    .export = exslerate_gem_prime_export,
+    .vmap = exslerate_gem_vmap,
+    .mmap = exslerate_gem_mmap,
+    .vm_ops = &drm_gem_cma_vm_ops,
+};
+
+static void exslerate_gem_heap_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_device *exsl_dev = gobj->dev->dev_private;
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  if (drm_mm_node_allocated(&abo->heap_node))
+    exslerate_heap_free(&exsl_dev->heap, &abo->heap_node);
+
+  drm_gem_object_release(gobj);
+  mutex_destroy(&abo->lock);
+  kfree(abo);
+}
+
+static const struct drm_gem_object_funcs exslerate_gem_heap_funcs = {
+    .free = exslerate_gem_heap_free_object,
+    .print_info = exslerate_gem_print_info,
+    .export = exslerate_gem_prime_export,
+    .vmap = exslerate_gem_vmap,
+    .mmap = exslerate_gem_mmap,
+    .vm_ops = &drm_gem_cma_vm_ops,
+};
+
+static void exslerate_gem_dma32_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_device *exsl_dev = gobj->dev->dev_private;
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  if (abo->base.vaddr)
+    dma_free_wc(exsl_dev->dma32_dev, gobj->size, abo->base.vaddr,
+                abo->base.paddr);
+
+  drm_gem_object_release(gobj);
+  mutex_destroy(&abo->lock);
+  kfree(abo);
+}
+
+/* drm_gem_cma_mmap(), for memory of the low memory-region's device */
+static int exslerate_gem_dma32_mmap(struct drm_gem_object *gobj,
+                                    struct vm_area_struct *vma) {
+  struct exslerate_device *exsl_dev = gobj->dev->dev_private;
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  vma->vm_pgoff -= drm_vma_node_start(&gobj->vma_node);
+  vma->vm_flags &= ~VM_PFNMAP;
+
+  return dma_mmap_wc(exsl_dev->dma32_dev, vma, abo->base.vaddr,
+                     abo->base.paddr, vma->vm_end - vma->vm_start);
+}
+
+static const struct drm_gem_object_funcs exslerate_gem_dma32_funcs = {
+    .free = exslerate_gem_dma32_free_object,
+    .print_info = exslerate_gem_print_info,
+    .export = exslerate_gem_prime_export,
+    .vmap = exslerate_gem_vmap,
+    .mmap = exslerate_gem_dma32_mmap,
+};
+
+static void exslerate_gem_evictable_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_device *exsl_dev = gobj->dev->dev_private;
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  exslerate_residency_remove(&exsl_dev->residency, abo);
+
+  drm_gem_object_release(gobj);
+  mutex_destroy(&abo->lock);
+  kfree(abo);
+}
+
+/* Importers would keep using the address after the BO moves */
+static struct dma_buf *
+exslerate_gem_evictable_export(struct drm_gem_object *gobj, int flags) {
+  DRM_DEBUG("Evictable BOs cannot be exported\n");
+  return ERR_PTR(-EINVAL);
+}
+
+/* Mapped a VMA at a time on fault, so eviction can zap the mapping */
+static const struct vm_operations_struct exslerate_gem_evictable_vm_ops = {
+    .fault = exslerate_residency_fault,
+    .open = drm_gem_vm_open,
+    .close = drm_gem_vm_close,
+};
+
+static const struct drm_gem_object_funcs exslerate_gem_evictable_funcs = {
+    .free = exslerate_gem_evictable_free_object,
+    .print_info = exslerate_gem_print_info,
+    .export = exslerate_gem_evictable_export,
+    .vm_ops = &exslerate_gem_evictable_vm_ops,
+};
+
+/* The GEM object spans the whole slab page, neighbouring BOs included */
+static struct dma_buf *exslerate_gem_slab_export(struct drm_gem_object *gobj,
+                                                 int flags) {
+  DRM_DEBUG("Slab BOs cannot be exported\n");
+  return ERR_PTR(-EINVAL);
+}
+
+static void exslerate_gem_slab_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  exslerate_slab_free(abo->slab, abo->slab_index);
+
+  drm_gem_object_release(gobj);
+  mutex_destroy(&abo->lock);
+  kfree(abo);
+}
+
+/* A sub-page BO maps, and prints, as the slab page it lives in */
+static const struct drm_gem_object_funcs exslerate_gem_slab_funcs = {
+    .free = exslerate_gem_slab_free_object,
+    .print_info = exslerate_gem_print_info,
+    .export = exslerate_gem_slab_export,
+    .vmap = exslerate_gem_vmap,
+    .mmap = exslerate_gem_mmap,
+    .vm_ops = &drm_gem_cma_vm_ops,
+};
+
+struct drm_gem_object *exslerate_gem_create_object_cb(struct drm_device *dev,
+                                                      size_t size) {
+  struct exslerate_gem_obj *abo;
+
+  abo = kzalloc(sizeof(*abo), GFP_KERNEL);
+  if (!abo)
+    return ERR_PTR(-ENOMEM);
+
+  to_gobj(abo)->funcs = &exslerate_gem_cma_funcs;
+  abo->type = EXSLERATE_BO_SHARE;
+  mutex_init(&abo->lock);
+  INIT_LIST_HEAD(&abo->lru_link);
+
+  /* The CMA helper initialises the GEM object */
+  abo->mem.userptr = EXSLERATE_INVALID_ADDR;
+  abo->mem.dev_addr = EXSLERATE_INVALID_ADDR;
+  abo->mem.size = size;
+
+  return to_gobj(abo);
+}
+
+/* drm_gem_cma_create(), taking the buffer from the cache when one fits */
+static struct drm_gem_cma_object *
+exslerate_gem_cma_create_cached(struct drm_device *dev, size_t size) {
+  struct exslerate_device *exsl_dev = dev->dev_private;
+  struct exslerate_bo_cache_entry *entry;
+  struct drm_gem_cma_object *cma;
+  struct drm_gem_object *gobj;
+  int32_t ret;
+
+  entry = exslerate_bo_cache_get(&exsl_dev->bo_cache, size);
+  if (!entry)
+    return drm_gem_cma_create(dev, size);
+
+  gobj = exslerate_gem_create_object_cb(dev, size);
+  if (IS_ERR(gobj)) {
+    dma_free_wc(dev->dev, size, entry->vaddr, entry->paddr);
+    kfree(entry);
+    return ERR_CAST(gobj);
+  }
+
+  drm_gem_private_object_init(dev, gobj, size);
+  cma = container_of(gobj, struct drm_gem_cma_object, base);
+  cma->vaddr = entry->vaddr;
+  cma->paddr = entry->paddr;
+  kfree(entry);
+
+  /* On failure the buffer goes back to the cache with the object */
+  ret = drm_gem_create_mmap_offset(gobj);
+  if (ret) {
+    drm_gem_object_put(gobj);
+    return ERR_PTR(ret);
+  }
+
+  return cma;
+}
+
+static struct exslerate_gem_obj *
+exslerate_drm_create_cma_bo(struct drm_device *dev,
+                            struct exsl_drm_create_bo *args,
+                            struct drm_file *file) {
+  struct exslerate_device *exsl_dev = dev->dev_private;
+  struct drm_gem_cma_object *cma;
+  struct exslerate_gem_obj *abo;
+  size_t size = args->size;
+
+  /* Round up small sizes to ensure CMA allocation */
+  if (size <= PAGE_SIZE)
+    size = round_up(size, 2 * PAGE_SIZE);
+  size = PAGE_ALIGN(size);
+
+  /* A full pool first gives up cached buffers and idle evictable BOs */
+  cma = exslerate_gem_cma_create_cached(dev, size);
+  while (PTR_ERR_OR_ZERO(cma) == -ENOMEM &&
+         exslerate_residency_reclaim(&exsl_dev->residency, size))
+    cma = exslerate_gem_cma_create_cached(dev, size);
+  if (IS_ERR(cma))
+    return ERR_CAST(cma);
+
+  abo = to_exsl_obj(&cma->base);
+  abo->mem.dev_addr =
+      cma->paddr; // This is correct - storing physical address in dev_addr
+  abo->mem.kva = cma->vaddr; // Kernel virtual address
+  abo->type = args->type;
+
+  DRM_DEBUG("CMA BO of 0x%zx at paddr %pad\n", size, &cma->paddr);
+
+  return abo;
+}
+
+/*
+ * CMA BO with a cacheable CPU mapping, for output the CPU post-processes.
+ * The no-map reserved pool can only be mapped write-combined, so these come
+ * from the system CMA area instead.
+ */
+static struct exslerate_gem_obj *
+exslerate_drm_create_cached_bo(struct drm_device *dev,
+                               struct exsl_drm_create_bo *args) {
+  size_t size = PAGE_ALIGN(args->size);
+  struct exslerate_gem_obj *abo;
+  struct drm_gem_object *gobj;
+  int32_t ret;
+
+  gobj = exslerate_gem_create_object_cb(dev, size);
+  if (IS_ERR(gobj))
+    return ERR_CAST(gobj);
+
+  /* From here on the free callback cleans up whatever was set up */
+  drm_gem_private_object_init(dev, gobj, size);
+  abo = to_exsl_obj(gobj);
+  abo->type = args->type;
+  abo->base.map_noncoherent = true;
+
+  abo->base.vaddr = dma_alloc_noncoherent(dev->dev, size, &abo->base.paddr,
+                                          DMA_BIDIRECTIONAL, GFP_KERNEL);
+  if (!abo->base.vaddr) {
+    ret = -ENOMEM;
+    goto put_obj;
+  }
+
+  ret = drm_gem_create_mmap_offset(gobj);
+  if (ret)
+    goto put_obj;
+
+  abo->mem.dev_addr = abo->base.paddr;
+  abo->mem.kva = abo->base.vaddr;
+
+  return abo;
+
+put_obj:
+  drm_gem_object_put(gobj);
+  return ERR_PTR(ret);
+}
+
+/*
+ * BO from the low memory-region, for the 32-bit bias and LUT slots when the
+ * reserved pool sits above 4 GiB
+ */
+static struct exslerate_gem_obj *
+exslerate_drm_create_dma32_bo(struct drm_device *dev,
+                              struct exsl_drm_create_bo *args) {
+  struct exslerate_device *exsl_dev = dev->dev_private;
+  size_t size = PAGE_ALIGN(args->size);
+  struct exslerate_gem_obj *abo;
+  struct drm_gem_object *gobj;
+  int32_t ret;
+
+  if (!exsl_dev->dma32_dev)
+    return ERR_PTR(-ENODEV);
+
+  gobj = exslerate_gem_create_object_cb(dev, size);
+  if (IS_ERR(gobj))
+    return ERR_CAST(gobj);
+
+  /* From here on the free callback cleans up whatever was set up */
+  gobj->funcs = &exslerate_gem_dma32_funcs;
+  drm_gem_private_object_init(dev, gobj, size);
+  abo = to_exsl_obj(gobj);
+  abo->type = args->type;
+  abo->flags = EXSL_BO_FLAG_DMA32;
+
+  abo->base.vaddr = dma_alloc_wc(exsl_dev->dma32_dev, size, &abo->base.paddr,
+                                 GFP_KERNEL);
+  if (!abo->base.vaddr) {
+    ret = -ENOMEM;
+    goto put_obj;
+  }
+
+  ret = drm_gem_create_mmap_offset(gobj);
+  if (ret)
+    goto put_obj;
+
+  abo->mem.dev_addr = abo->base.paddr;
+  abo->mem.kva = abo->base.vaddr;
+
+  return abo;
+
+put_obj:
+  drm_gem_object_put(gobj);
+  return ERR_PTR(ret);
+}
+
+/* Pool BO the driver may evict to system memory when the pool is full */
+static struct exslerate_gem_obj *
+exslerate_drm_create_evictable_bo(struct drm_device *dev,
+                                  struct exsl_drm_create_bo *args) {
+  struct exslerate_device *exsl_dev = dev->dev_private;
+  size_t size = PAGE_ALIGN(args->size);
+  struct exslerate_gem_obj *abo;
+  struct drm_gem_object *gobj;
+  int32_t ret;
+
+  gobj = exslerate_gem_create_object_cb(dev, size);
+  if (IS_ERR(gobj))
+    return ERR_CAST(gobj);
+
+  /* From here on the free callback cleans up whatever was set up */
+  gobj->funcs = &exslerate_gem_evictable_funcs;
+  drm_gem_private_object_init(dev, gobj, size);
+  abo = to_exsl_obj(gobj);
+  abo->type = args->type;
+  abo->flags = EXSL_BO_FLAG_EVICTABLE;
+
+  ret = exslerate_residency_add(&exsl_dev->residency, abo);
+  if (ret)
+    goto put_obj;
+
+  ret = drm_gem_create_mmap_offset(gobj);
+  if (ret)
+    goto put_obj;
+
+  return abo;
+
+put_obj:
+  drm_gem_object_put(gobj);
+  return ERR_PTR(ret);
+}
+
+/* Pack a small BO into a slab page of the file */
+static struct exslerate_gem_obj *
+exslerate_drm_create_slab_bo(struct drm_device *dev,
+                             struct exsl_drm_create_bo *args,
+                             struct drm_file *file) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_gem_obj *abo;
+  uint32_t offset;
+  int32_t ret;
+
+  abo = kzalloc(sizeof(*abo), GFP_KERNEL);
+  if (!abo)
+    return ERR_PTR(-ENOMEM);
+
+  ret = exslerate_slab_alloc(fpriv->slab_pool, args->size, &abo->slab,
+                             &abo->slab_index);
+  if (ret) {
+    kfree(abo);
+    return ERR_PTR(ret);
+  }
+  offset = abo->slab_index * abo->slab->obj_size;
+
+  to_gobj(abo)->funcs = &exslerate_gem_slab_funcs;
+  drm_gem_private_object_init(dev, to_gobj(abo), PAGE_SIZE);
+  mutex_init(&abo->lock);
+  abo->type = args->type;
+
+  abo->base.paddr = abo->slab->paddr;
+  abo->base.vaddr = abo->slab->vaddr;
+  abo->mem.userptr = EXSLERATE_INVALID_ADDR;
+  abo->mem.dev_addr = abo->slab->paddr + offset;
+  abo->mem.kva = abo->slab->vaddr + offset;
+  abo->mem.size = args->size;
+
+  return abo;
+}
+
+/* Direction the device accesses a userptr BO's pages in */
+static enum dma_data_direction
+exslerate_userptr_dir(struct exslerate_gem_obj *abo) {
+  return (abo->flags & EXSL_BO_FLAG_READ_ONLY) ? DMA_TO_DEVICE :
+                                                 DMA_BIDIRECTIONAL;
+}
+
+static void exslerate_gem_userptr_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+  enum dma_data_direction dir = exslerate_userptr_dir(abo);
+
+  dma_unmap_sgtable(gobj->dev->dev, abo->sgt, dir, 0);
+  sg_free_table(abo->sgt);
+  kfree(abo->sgt);
+  unpin_user_pages_dirty_lock(abo->mem.pages, abo->mem.nr_pages,
+                              dir != DMA_TO_DEVICE);
+  kvfree(abo->mem.pages);
+
+  drm_gem_object_release(gobj);
+  mutex_destroy(&abo->lock);
+  kfree(abo);
+}
+
+/* The owner already has the memory mapped */
+static int exslerate_gem_userptr_mmap(struct drm_gem_object *gobj,
+                                      struct vm_area_struct *vma) {
+  return -EINVAL;
+}
+
+static const struct drm_gem_object_funcs exslerate_gem_userptr_funcs = {
+    .free = exslerate_gem_userptr_free_object,
+    .print_info = exslerate_gem_print_info,
+    .export = exslerate_gem_prime_export,
+    .mmap = exslerate_gem_userptr_mmap,
+};
+
+static void exslerate_gem_import_free_object(struct drm_gem_object *gobj) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  drm_prime_gem_destroy(gobj, abo->base.sgt);
+  drm_gem_object_release(gobj);
+  mutex_destroy(&abo->lock);
+  kfree(abo);
+}
+
+/* CPU mappings of imported buffers come from the exporter */
+static int exslerate_gem_import_mmap(struct drm_gem_object *gobj,
+                                     struct vm_area_struct *vma) {
+  /* Drop the reference drm_gem_mmap_obj() took, the dma-buf holds one */
+  drm_gem_object_put(gobj);
+  vma->vm_private_data = NULL;
+
+  return dma_buf_mmap(gobj->dma_buf, vma, 0);
+}
+
+static const struct drm_gem_object_funcs exslerate_gem_import_funcs = {
+    .free = exslerate_gem_import_free_object,
+    .print_info = exslerate_gem_print_info,
+    .mmap = exslerate_gem_import_mmap,
+};
+
+/*
+ * Wrap a dma-buf from another device, e.g. a V4L2 capture buffer. The cores
+ * have no scatter-gather, so it has to be one contiguous device range.
+ */
+static struct drm_gem_object *
+exslerate_gem_prime_import_sg_table(struct drm_device *dev,
+                                    struct dma_buf_attachment *attach,
+                                    struct sg_table *sgt) {
+  struct exslerate_gem_obj *abo;
+  size_t size = attach->dmabuf->size;
+
+  if (drm_prime_get_contiguous_size(sgt) < size) {
+    DRM_DEBUG("Imported dma-buf of 0x%zx is not contiguous\n", size);
+    return ERR_PTR(-EINVAL);
+  }
+
+  abo = kzalloc(sizeof(*abo), GFP_KERNEL);
+  if (!abo)
+    return ERR_PTR(-ENOMEM);
+
+  to_gobj(abo)->funcs = &exslerate_gem_import_funcs;
+  drm_gem_private_object_init(dev, to_gobj(abo), size);
+  mutex_init(&abo->lock);
+  abo->type = EXSL_BO_SHARE;
+
+  abo->base.sgt = sgt;
+  abo->base.paddr = sg_dma_address(sgt->sgl);
+  abo->mem.userptr = EXSLERATE_INVALID_ADDR;
+  abo->mem.dev_addr = abo->base.paddr;
+  abo->mem.size = size;
+
+  DRM_DEBUG("Imported dma-buf of 0x%zx at dev_addr 0x%llx\n", size,
+            abo->mem.dev_addr);
+
+  return to_gobj(abo);
+}
+
+/* Our own dma-bufs come back as the BO they were exported from */
+static struct drm_gem_object *
+exslerate_gem_prime_import(struct drm_device *dev, struct dma_buf *dma_buf) {
+  struct drm_gem_object *gobj = dma_buf->priv;
+
+  if (dma_buf->ops == &exslerate_dmabuf_ops && gobj->dev == dev) {
+    drm_gem_object_get(gobj);
+    return gobj;
+  }
+
+  return drm_gem_prime_import(dev, dma_buf);
+}
+
+/*
+ * Pin user memory and map it for the device, without copying. The cores
+ * have no scatter-gather, so the pages must land in one contiguous device
+ * address range.
+ */
+static struct exslerate_gem_obj *
+exslerate_drm_create_userptr_bo(struct drm_device *dev,
+                                struct exsl_drm_create_bo *args) {
+  bool read_only = args->flags & EXSL_BO_FLAG_READ_ONLY;
+  enum dma_data_direction dir;
+  struct exslerate_gem_obj *abo;
+  struct page **pages;
+  struct sg_table *sgt;
+  uint32_t nr_pages;
+  int32_t pinned, ret;
+
+  if (!args->vaddr || offset_in_page(args->vaddr) ||
+      offset_in_page(args->size) || args->size > UINT_MAX) {
+    DRM_ERROR("Userptr 0x%llx size 0x%llx not page aligned\n", args->vaddr,
+              args->size);
+    return ERR_PTR(-EINVAL);
+  }
+  nr_pages = args->size >> PAGE_SHIFT;
+
+  abo = kzalloc(sizeof(*abo), GFP_KERNEL);
+  pages = kvmalloc_array(nr_pages, sizeof(*pages), GFP_KERNEL);
+  sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+  if (!abo || !pages || !sgt) {
+    ret = -ENOMEM;
+    goto free;
+  }
+
+  pinned = pin_user_pages_fast(args->vaddr, nr_pages,
+                               (read_only ? 0 : FOLL_WRITE) | FOLL_LONGTERM,
+                               pages);
+  if (pinned < 0) {
+    ret = pinned;
+    goto free;
+  }
+  if (pinned != nr_pages) {
+    ret = -EFAULT;
+    goto unpin;
+  }
+
+  ret = sg_alloc_table_from_pages(sgt, pages, nr_pages, 0, args->size,
+                                  GFP_KERNEL);
+  if (ret)
+    goto unpin;
+
+  dir = read_only ? DMA_TO_DEVICE : DMA_BIDIRECTIONAL;
+  ret = dma_map_sgtable(dev->dev, sgt, dir, 0);
+  if (ret)
+    goto free_sgt;
+
+  if (sgt->nents != 1) {
+    DRM_DEBUG("Userptr 0x%llx is in %u device ranges, need 1\n", args->vaddr,
+              sgt->nents);
+    ret = -EINVAL;
+    goto unmap;
+  }
+
+  to_gobj(abo)->funcs = &exslerate_gem_userptr_funcs;
+  drm_gem_private_object_init(dev, to_gobj(abo), args->size);
+  mutex_init(&abo->lock);
+  abo->type = args->type;
+  abo->flags = args->flags;
+
+  abo->sgt = sgt;
+  abo->base.paddr = sg_dma_address(sgt->sgl);
+  abo->mem.userptr = args->vaddr;
+  abo->mem.pages = pages;
+  abo->mem.nr_pages = nr_pages;
+  abo->mem.dev_addr = abo->base.paddr;
+  abo->mem.size = args->size;
+
+  return abo;
+
+unmap:
+  dma_unmap_sgtable(dev->dev, sgt, dir, 0);
+free_sgt:
+  sg_free_table(sgt);
+unpin:
+  unpin_user_pages(pages, pinned);
+free:
+  kfree(sgt);
+  kvfree(pages);
+  kfree(abo);
+  return ERR_PTR(ret);
+}
+
+/*
+ * Cache maintenance around device access for userptr BOs, the only ones
+ * with an sg_table. EXSL_BO_FLAG_CACHED BOs are maintained by userspace
+ * with CPU_PREP/CPU_FINI instead.
+ */
+void exslerate_gem_sync_for_device(struct drm_gem_object *gobj) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  if (abo->sgt)
+    dma_sync_sgtable_for_device(gobj->dev->dev, abo->sgt,
+                                exslerate_userptr_dir(abo));
+}
+
+void exslerate_gem_sync_for_cpu(struct drm_gem_object *gobj) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+
+  if (abo->sgt)
+    dma_sync_sgtable_for_cpu(gobj->dev->dev, abo->sgt,
+                             exslerate_userptr_dir(abo));
+}
+
+/*
+ * Wrap a range of the device heap in a BO: the whole heap for DEV_HEAP, a
+ * new, cleared sub-allocation for DEV. The whole heap holds every file's
+ * DEV BOs, so only the DRM master or CAP_SYS_ADMIN may map it.
+ */
+static struct exslerate_gem_obj *
+exslerate_drm_create_heap_bo(struct drm_device *dev,
+                             struct exsl_drm_create_bo *args,
+                             struct drm_file *file) {
+  struct exslerate_device *exsl_dev = dev->dev_private;
+  struct exslerate_heap *heap = &exsl_dev->heap;
+  struct exslerate_gem_obj *abo;
+  uint64_t offset = 0;
+  size_t size;
+  int32_t ret;
+
+  if (!heap->size)
+    return ERR_PTR(-ENODEV);
+
+  abo = kzalloc(sizeof(*abo), GFP_KERNEL);
+  if (!abo)
+    return ERR_PTR(-ENOMEM);
+
+  if (args->type == EXSL_BO_DEV_HEAP) {
+    if (!drm_is_current_master(file) && !capable(CAP_SYS_ADMIN)) {
+      ret = -EACCES;
+      goto free_abo;
+    }
+    if (args->size > heap->size) {
+      ret = -EINVAL;
+      goto free_abo;
+    }
+    size = heap->size;
+    args->size = size;
+  } else {
+    ret = exslerate_heap_alloc(heap, &abo->heap_node, args->size);
+    if (ret) {
+      DRM_DEBUG("Device heap allocation of 0x%llx failed: %d\n", args->size,
+                ret);
+      goto free_abo;
+    }
+    offset = abo->heap_node.start;
+    size = abo->heap_node.size;
+
+    /* The range may hold another file's freed data */
+    memset(heap->kva + offset, 0, size);
+  }
+
+  to_gobj(abo)->funcs = &exslerate_gem_heap_funcs;
+  drm_gem_private_object_init(dev, to_gobj(abo), size);
+  mutex_init(&abo->lock);
+  abo->type = args->type;
+
+  abo->base.paddr = heap->dma_addr + offset;
+  abo->base.vaddr = heap->kva + offset;
+  abo->mem.userptr = EXSLERATE_INVALID_ADDR;
+  abo->mem.dev_addr = abo->base.paddr;
+  abo->mem.kva = abo->base.vaddr;
+  abo->mem.size = size;
+
+  return abo;
+
+free_abo:
+  kfree(abo);
+  return ERR_PTR(ret);
+}
+
+/*
+ * Pack the context's current config for a job that names no descriptor.
+ * Later config writes then cannot affect a job that is already queued.
+ */
+static struct exslerate_layer_desc *
+exsl_hwctx_pack_config(struct exslerate_hwctx *hwctx) {
+  struct exslerate_layer_desc *desc;
+
+  mutex_lock(&hwctx->config_lock);
+  desc = exslerate_desc_alloc(hwctx->exsl_dev, EXSL_CONV_CORE, &hwctx->config);
+  mutex_unlock(&hwctx->config_lock);
+
+  return desc;
+}
+
+/* Copy in the relocations of an EXEC_BUF and hand them to @task */
+static int32_t exsl_submit_relocs(struct exslerate_task *task,
+                                  struct exsl_submit_args *args) {
+  struct exsl_submit_relocs ext;
+  struct exsl_reloc *relocs;
+
+  if (copy_from_user(&ext, u64_to_user_ptr(args->ext), sizeof(ext)))
+    return -EFAULT;
+
+  if (ext.pad || !ext.count || ext.count > EXSLERATE_MAX_JOB_RELOCS) {
+    DRM_ERROR("Invalid number of relocations: %u\n", ext.count);
+    return -EINVAL;
+  }
+
+  relocs = kvmalloc_array(ext.count, sizeof(*relocs), GFP_KERNEL);
+  if (!relocs)
+    return -ENOMEM;
+
+  if (copy_from_user(relocs, u64_to_user_ptr(ext.relocs),
+                     ext.count * sizeof(*relocs))) {
+    kvfree(relocs);
+    return -EFAULT;
+  }
+
+  return exslerate_task_set_relocs(task, relocs, ext.count);
+}
+
+static int32_t exsl_submit_exec_buf(struct exslerate_hwctx *hwctx,
+                                    struct exsl_submit_args *args,
+                                    struct drm_file *file) {
+  struct exslerate_layer_desc *desc;
+  struct exslerate_task *task;
+  uint32_t *desc_handles;
+  int32_t ret;
+
+  if (args->arg_count > EXSLERATE_MAX_GRAPH_LAYERS) {
+    DRM_ERROR("Too many layers in one job: %u\n", args->arg_count);
+    return -EINVAL;
+  }
+
+  task = exslerate_task_create(hwctx->exsl_dev, file);
+  if (IS_ERR(task))
+    return PTR_ERR(task);
+
+  ret = exslerate_task_lookup_bos(task, u64_to_user_ptr(args->cmd_handles),
+                                  args->cmd_count);
+  if (ret)
+    goto put_task;
+
+  if (args->arg_count) {
+    desc_handles = memdup_user(u64_to_user_ptr(args->args),
+                               args->arg_count * sizeof(*desc_handles));
+    if (IS_ERR(desc_handles)) {
+      ret = PTR_ERR(desc_handles);
+      goto put_task;
+    }
+
+    ret = exslerate_task_lookup_descs(task, desc_handles, args->arg_count);
+    kfree(desc_handles);
+  } else {
+    desc = exsl_hwctx_pack_config(hwctx);
+    if (IS_ERR(desc)) {
+      ret = PTR_ERR(desc);
+      goto put_task;
+    }
+
+    ret = exslerate_task_set_desc(task, desc);
+  }
+  if (ret)
+    goto put_task;
+
+  if (args->ext_flags & EXSL_SUBMIT_EXT_RELOCS) {
+    ret = exsl_submit_relocs(task, args);
+    if (ret)
+      goto put_task;
+  }
+
+  ret = exslerate_task_push(hwctx, task, &args->seq);
+
+put_task:
+  exslerate_task_put(task);
+  return ret;
+}
+
+/*
+ * DEPENDENCY and SIGNAL submits take syncobj handles in cmd_handles and,
+ * for timeline syncobjs, one point per handle in args (0 = binary syncobj).
+ */
+static int32_t exsl_copy_syncobj_args(struct exsl_submit_args *args,
+                                      uint32_t **handles, uint64_t **points) {
+  *handles = NULL;
+  *points = NULL;
+
+  if (args->arg_count && args->arg_count != args->cmd_count) {
+    DRM_ERROR("Expected %u timeline points, got %u\n", args->cmd_count,
+              args->arg_count);
+    return -EINVAL;
+  }
+
+  *handles = memdup_user(u64_to_user_ptr(args->cmd_handles),
+                         args->cmd_count * sizeof(**handles));
+  if (IS_ERR(*handles)) {
+    int32_t ret = PTR_ERR(*handles);
+
+    *handles = NULL;
+    return ret;
+  }
+
+  if (args->arg_count) {
+    *points = memdup_user(u64_to_user_ptr(args->args),
+                          args->arg_count * sizeof(**points));
+    if (IS_ERR(*points)) {
+      int32_t ret = PTR_ERR(*points);
+
+      *points = NULL;
+      kfree(*handles);
+      *handles = NULL;
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Queue a barrier: later jobs on the context start once the syncobjs signal.
+ * Each engine runs the context's jobs from its own queue, so every engine
+ * gets a barrier job.
+ */
+static int32_t exsl_submit_dependency(struct exslerate_hwctx *hwctx,
+                                      struct exsl_submit_args *args,
+                                      struct drm_file *file) {
+  struct exslerate_task *task;
+  uint32_t *handles, i;
+  uint64_t *points;
+  int32_t ret;
+
+  ret = exsl_copy_syncobj_args(args, &handles, &points);
+  if (ret)
+    return ret;
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    task = exslerate_task_create(hwctx->exsl_dev, file);
+    if (IS_ERR(task)) {
+      ret = PTR_ERR(task);
+      break;
+    }
+    task->type = EXSL_CMD_SUBMIT_DEPENDENCY;
+    task->core_type = i;
+
+    ret = exslerate_task_add_syncobj_deps(task, handles, points,
+                                          args->cmd_count);
+    if (!ret)
+      ret = exslerate_task_push(hwctx, task, &args->seq);
+
+    exslerate_task_put(task);
+    if (ret)
+      break;
+  }
+
+  kfree(points);
+  kfree(handles);
+  return ret;
+}
+
+/* Attach a fence covering every job submitted on the context to syncobjs */
+static int32_t exsl_submit_signal(struct exslerate_hwctx *hwctx,
+                                  struct exsl_submit_args *args,
+                                  struct drm_file *file) {
+  uint32_t *handles;
+  uint64_t *points;
+  int32_t ret;
+
+  ret = exsl_copy_syncobj_args(args, &handles, &points);
+  if (ret)
+    return ret;
+
+  ret = exslerate_hwctx_signal_syncobjs(hwctx, file, handles, points,
+                                        args->cmd_count, &args->seq);
+
+  kfree(points);
+  kfree(handles);
+  return ret;
+}
+
+static int32_t exsl_submit(struct drm_device *drm, void *arg,
+                           struct drm_file *file) {
+  struct exsl_submit_args *args = arg;
+  struct exslerate_hwctx *hwctx;
+  int32_t ret;
+
+  DRM_DEBUG("Submit request: type=%u, cmd_count=%u\n", args->type,
+            args->cmd_count);
+
+  if (args->cmd_count == 0 || args->cmd_count > EXSLERATE_MAX_JOB_HANDLES) {
+    DRM_ERROR("Invalid number of handles: %u\n", args->cmd_count);
+    return -EINVAL;
+  }
+
+  if (!args->cmd_handles) {
+    DRM_ERROR("Invalid handle list pointer\n");
+    return -EINVAL;
+  }
+
+  /* Relocations are the only extension, and only jobs have addresses */
+  if ((args->ext_flags & ~EXSL_SUBMIT_EXT_RELOCS) ||
+      (args->ext_flags && args->type != EXSL_CMD_SUBMIT_EXEC_BUF)) {
+    DRM_ERROR("Invalid submit extension flags 0x%llx\n", args->ext_flags);
+    return -EINVAL;
+  }
+
+  hwctx = exslerate_hwctx_get(file, args->hwctx);
+  if (!hwctx) {
+    DRM_ERROR("Invalid hardware context: %u\n", args->hwctx);
+    return -ENOENT;
+  }
+
+  switch (args->type) {
+  case EXSL_CMD_SUBMIT_EXEC_BUF:
+    ret = exsl_submit_exec_buf(hwctx, args, file);
+    break;
+  case EXSL_CMD_SUBMIT_DEPENDENCY:
+    ret = exsl_submit_dependency(hwctx, args, file);
+    break;
+  case EXSL_CMD_SUBMIT_SIGNAL:
+    ret = exsl_submit_signal(hwctx, args, file);
+    break;
+  default:
+    DRM_ERROR("Unsupported submit type: %u\n", args->type);
+    ret = -EINVAL;
+    break;
+  }
+
+  exslerate_hwctx_put(hwctx);
+  return ret;
+}
 
-static void exslerate_gem_free_object(struct drm_gem_object *gobj) {
-  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+static int32_t exsl_wait(struct drm_device *drm, void *data,
+                         struct drm_file *file) {
+  struct exsl_wait_args *args = data;
+  struct exslerate_job_timing timing;
+  struct exslerate_hwctx *hwctx;
+  int32_t ret;
 
-  if (abo->mem.pages) {
-    u32 i;
-    for (i = 0; i < abo->mem.nr_pages; i++) {
-      if (abo->mem.pages[i])
-        put_page(abo->mem.pages[i]);
-    }
-    kvfree(abo->mem.pages);
+  hwctx = exslerate_hwctx_get(file, args->hwctx);
+  if (!hwctx) {
+    DRM_ERROR("Invalid hardware context: %u\n", args->hwctx);
+    return -ENOENT;
   }
 
-  mutex_destroy(&abo->lock);
-  drm_gem_cma_free_object(gobj);
+  ret = exslerate_hwctx_wait(hwctx, args->seq, args->timeout_ms, &timing);
+  exslerate_hwctx_put(hwctx);
+
+  args->busy_ns = timing.busy_ns;
+  args->idle_gap_ns = timing.idle_gap_ns;
+  return ret;
 }
 
-static void exslerate_gem_print_info(struct drm_printer *p, unsigned int indent,
-                                     const struct drm_gem_object *gobj) {
-  drm_gem_cma_print_info(p, indent, gobj);
+static int32_t exsl_create_hwctx(struct drm_device *drm, void *data,
+                                 struct drm_file *file) {
+  struct exsl_hwctx_args *args = data;
+
+  if (args->pad)
+    return -EINVAL;
+
+  return exslerate_hwctx_create(file, &args->handle);
 }
 
-static const struct drm_gem_object_funcs exslerate_gem_cma_funcs = {
-    .free = exslerate_gem_free_object,
-    .print_info = exslerate_gem_print_info,
-    .vm_ops = &drm_gem_cma_vm_ops,
-};
+static int32_t exsl_destroy_hwctx(struct drm_device *drm, void *data,
+                                  struct drm_file *file) {
+  struct exsl_hwctx_args *args = data;
 
-struct drm_gem_object *exslerate_gem_create_object_cb(struct drm_device *dev,
-                                                      size_t size) {
-  struct exslerate_gem_obj *abo;
+  if (args->pad)
+    return -EINVAL;
 
-  abo = kzalloc(sizeof(*abo), GFP_KERNEL);
-  if (!abo)
-    return ERR_PTR(-ENOMEM);
+  return exslerate_hwctx_destroy(file, args->handle);
+}
 
-  to_gobj(abo)->funcs = &exslerate_gem_cma_funcs;
-  abo->type = EXSLERATE_BO_SHARE;
-  mutex_init(&abo->lock);
+/* Replace the layer configuration of a hardware context */
+static int32_t exslerate_hwctx_set_config(struct drm_file *file,
+                                          uint32_t handle,
+                                          const void __user *config) {
+  struct exslerate_hwctx *hwctx;
+  int32_t ret = 0;
 
-  drm_gem_object_init(dev, to_gobj(abo), size);
+  hwctx = exslerate_hwctx_get(file, handle);
+  if (!hwctx) {
+    DRM_ERROR("Invalid hardware context: %u\n", handle);
+    return -ENOENT;
+  }
 
-  abo->mem.userptr = EXSLERATE_INVALID_ADDR;
-  abo->mem.dev_addr = EXSLERATE_INVALID_ADDR;
-  abo->mem.size = size;
+  mutex_lock(&hwctx->config_lock);
+  if (copy_from_user(&hwctx->config, config, sizeof(hwctx->config)))
+    ret = -EFAULT;
+  mutex_unlock(&hwctx->config_lock);
 
-  return to_gobj(abo);
+  exslerate_hwctx_put(hwctx);
+  return ret;
 }
 
-static struct exslerate_gem_obj *
-exslerate_drm_create_cma_bo(struct drm_device *dev,
-                            struct exsl_drm_create_bo *args,
-                            struct drm_file *file) {
-  struct drm_gem_cma_object *cma;
-  struct exslerate_gem_obj *abo;
-  size_t size = args->size;
-
-  /* Round up small sizes to ensure CMA allocation */
-  if (size <= PAGE_SIZE)
-    size = round_up(size, 2 * PAGE_SIZE);
+static int32_t exsl_create_desc(struct drm_device *drm, void *data,
+                                struct drm_file *file) {
+  struct exsl_create_desc_args *args = data;
+  size_t config_size;
+  void *config;
+  int32_t ret;
 
-  cma = drm_gem_cma_create(dev, size);
-  if (IS_ERR(cma))
-    return ERR_CAST(cma);
+  switch (args->core_type) {
+  case EXSL_CONV_CORE:
+    config_size = sizeof(struct exsl_write_config_args);
+    break;
+  case EXSL_GEMM_CORE:
+    /* No register map for the GEMM core in the bitstream yet */
+    return -EOPNOTSUPP;
+  default:
+    DRM_ERROR("Invalid core type: %u\n", args->core_type);
+    return -EINVAL;
+  }
 
-  abo = to_exsl_obj(&cma->base);
-  abo->mem.dev_addr =
-      cma->paddr; // This is correct - storing physical address in dev_addr
-  abo->mem.kva = cma->vaddr; // Kernel virtual address
-  abo->type = args->type;
+  if (!args->config)
+    return -EINVAL;
 
-  // Fixed printk format - use %p for void* and proper field names
-  printk(KERN_ERR "cma->vaddr = %p, cma->paddr = 0x%llx, size = 0x%zx\n",
-         cma->vaddr, (unsigned long long)cma->paddr, size);
+  config = memdup_user(u64_to_user_ptr(args->config), config_size);
+  if (IS_ERR(config))
+    return PTR_ERR(config);
 
-  return abo;
+  ret = exslerate_desc_create(file, args->core_type, config, &args->handle);
+  kfree(config);
+  return ret;
 }
 
-static int32_t exsl_submit(struct drm_device *drm, void *arg,
-                           struct drm_file *file) {
-  struct exsl_submit_args *args = arg;
-
-  DRM_INFO("Submit request: type=%u, cmd_count=%u\n", args->type,
-           args->cmd_count);
+static int32_t exsl_destroy_desc(struct drm_device *drm, void *data,
+                                 struct drm_file *file) {
+  struct exsl_destroy_desc_args *args = data;
 
-  if (args->cmd_count == 0 || args->cmd_count > 16) {
-    DRM_ERROR("Invalid number of handles: %u\n", args->cmd_count);
+  if (args->pad)
     return -EINVAL;
-  }
 
-  if (!args->cmd_handles) {
-    DRM_ERROR("Invalid handle list pointer\n");
+  return exslerate_desc_destroy(file, args->handle);
+}
+
+static int32_t exsl_config_hwctx(struct drm_device *drm, void *data,
+                                 struct drm_file *file) {
+  struct exsl_config_hwctx_args *args = data;
+
+  if (args->pad || !args->config)
     return -EINVAL;
-  }
 
-  /* TODO: actual submission */
-  return 0;
+  return exslerate_hwctx_set_config(file, args->handle,
+                                    u64_to_user_ptr(args->config));
 }
 
-static int32_t exsl_create_bo(struct drm_device *dev, void *data,
-                              struct drm_file *file) {
-  struct exsl_drm_create_bo *args = data;
-  struct exslerate_gem_obj *abo;
-  int ret;
+/* Allocate a BO as CREATE_BO describes it; the caller owns the reference */
+static struct exslerate_gem_obj *
+exslerate_gem_create_bo(struct drm_device *dev, struct exsl_drm_create_bo *args,
+                        struct drm_file *file) {
+  struct exslerate_device *exsl_dev = dev->dev_private;
 
-  if (args->flags || !args->size) {
+  if ((args->flags & ~(EXSL_BO_FLAG_CACHED | EXSL_BO_FLAG_EVICTABLE |
+                       EXSL_BO_FLAG_READ_ONLY | EXSL_BO_FLAG_DMA32)) ||
+      hweight64(args->flags) > 1 || !args->size) {
     DRM_ERROR("Invalid BO args: flags=0x%llx, size=%llu\n", args->flags,
               args->size);
-    return -EINVAL;
+    return ERR_PTR(-EINVAL);
   }
 
   switch (args->type) {
   case EXSL_BO_SHARE:
   case EXSL_BO_CMD:
   case EXSL_BO_DMA:
+    if (args->flags & EXSL_BO_FLAG_READ_ONLY)
+      return ERR_PTR(-EINVAL);
+    if (args->flags & EXSL_BO_FLAG_CACHED)
+      return exslerate_drm_create_cached_bo(dev, args);
+    if (args->flags & EXSL_BO_FLAG_EVICTABLE)
+      return exslerate_drm_create_evictable_bo(dev, args);
+    /* A pool below 4 GiB serves DMA32 BOs like any other */
+    if ((args->flags & EXSL_BO_FLAG_DMA32) && exsl_dev->dma32_dev != dev->dev)
+      return exslerate_drm_create_dma32_bo(dev, args);
+    /* SHARE BOs get their own pages so they can be exported */
+    if (args->type != EXSL_BO_SHARE && args->size <= EXSLERATE_SLAB_MAX_SIZE)
+      return exslerate_drm_create_slab_bo(dev, args, file);
+    return exslerate_drm_create_cma_bo(dev, args, file);
+  case EXSL_BO_DEV_HEAP:
   case EXSL_BO_DEV:
-    abo = exslerate_drm_create_cma_bo(dev, args, file);
-    break;
+    if (args->flags)
+      return ERR_PTR(-EINVAL);
+    return exslerate_drm_create_heap_bo(dev, args, file);
+  case EXSL_BO_USERPTR:
+    if (args->flags & ~EXSL_BO_FLAG_READ_ONLY)
+      return ERR_PTR(-EINVAL);
+    return exslerate_drm_create_userptr_bo(dev, args);
   default:
-    return -EINVAL;
+    return ERR_PTR(-EINVAL);
   }
+}
+
+static int32_t exsl_create_bo(struct drm_device *dev, void *data,
+                              struct drm_file *file) {
+  struct exsl_drm_create_bo *args = data;
+  struct exslerate_gem_obj *abo;
+  int ret;
 
+  abo = exslerate_gem_create_bo(dev, args, file);
   if (IS_ERR(abo))
     return PTR_ERR(abo);
 
@@ -164,11 +1502,32 @@ static int32_t exsl_gem_destroy(struct drm_device *drm, void *data,
   return drm_gem_handle_delete(file, args->handle);
 }
 
+/* Fill in the GEM_MMAP outputs of a BO, creating its mmap offset */
+static int32_t exslerate_gem_map_info(struct drm_gem_object *gobj,
+                                      struct exsl_gem_map_offset_args *args) {
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+  int32_t ret;
+
+  /* Create a mappable offset if it doesn't exist yet */
+  ret = drm_gem_create_mmap_offset(gobj);
+  if (ret)
+    return ret;
+
+  /* Get the correct addresses */
+  args->map_offset = drm_vma_node_offset_addr(&gobj->vma_node);
+  /* An evictable BO moves, it is only addressed through relocations */
+  args->dev_addr = (abo->flags & EXSL_BO_FLAG_EVICTABLE) ?
+                       EXSLERATE_INVALID_ADDR :
+                       abo->mem.dev_addr;
+  args->vaddr = (u64)abo->mem.kva;
+  args->offset = offset_in_page(abo->mem.dev_addr);
+  return 0;
+}
+
 static int32_t exsl_gem_map_offset(struct drm_device *drm, void *data,
                                    struct drm_file *file) {
   struct exsl_gem_map_offset_args *args = data;
   struct drm_gem_object *gobj;
-  struct exslerate_gem_obj *abo;
   int ret;
 
   gobj = drm_gem_object_lookup(file, args->handle);
@@ -177,36 +1536,222 @@ static int32_t exsl_gem_map_offset(struct drm_device *drm, void *data,
     return -ENOENT;
   }
 
-  abo = to_exsl_obj(gobj);
-
-  /* Create a mappable offset if it doesn't exist yet */
-  ret = drm_gem_create_mmap_offset(gobj);
+  ret = exslerate_gem_map_info(gobj, args);
   if (ret) {
     DRM_ERROR("Failed to create mmap offset for handle %d\n", args->handle);
     drm_gem_object_put(gobj);
     return ret;
   }
 
-  /* Get the correct addresses */
-  args->map_offset = drm_vma_node_offset_addr(&gobj->vma_node);
-  args->dev_addr = abo->mem.dev_addr;
-  args->vaddr = (u64)abo->mem.kva;
+  DRM_DEBUG("GEM handle %d: map_offset=0x%llx, dev_addr=0x%llx, vaddr=0x%llx, "
+            "offset=0x%x\n",
+            args->handle, args->map_offset, args->dev_addr, args->vaddr,
+            args->offset);
+
+  drm_gem_object_put(gobj);
+  return 0;
+}
+
+/* Create, map and hand out a handle for one entry of a CREATE_BOS batch */
+static int32_t exsl_create_bos_one(struct drm_device *dev,
+                                   struct exsl_bo_batch_entry *bo,
+                                   struct drm_file *file) {
+  struct exsl_drm_create_bo create = {
+      .flags = bo->flags,
+      .vaddr = bo->vaddr,
+      .size = bo->size,
+      .type = bo->type,
+  };
+  struct exsl_gem_map_offset_args map;
+  struct exslerate_gem_obj *abo;
+  int32_t ret;
+
+  abo = exslerate_gem_create_bo(dev, &create, file);
+  if (IS_ERR(abo))
+    return PTR_ERR(abo);
+
+  ret = exslerate_gem_map_info(to_gobj(abo), &map);
+  if (!ret)
+    ret = drm_gem_handle_create(file, to_gobj(abo), &bo->handle);
+  drm_gem_object_put(to_gobj(abo));
+  if (ret)
+    return ret;
+
+  bo->size = create.size;
+  bo->map_offset = map.map_offset;
+  bo->dev_addr = map.dev_addr;
+  bo->offset = map.offset;
+  return 0;
+}
+
+static int32_t exsl_create_bos(struct drm_device *dev, void *data,
+                               struct drm_file *file) {
+  struct exsl_create_bos_args *args = data;
+  struct exsl_bo_batch_entry *bos;
+  int32_t ret = 0;
+  uint32_t i;
+
+  if (args->pad || !args->count || args->count > EXSL_MAX_BO_BATCH) {
+    DRM_ERROR("Invalid number of BOs: %u\n", args->count);
+    return -EINVAL;
+  }
+
+  bos = kvmalloc_array(args->count, sizeof(*bos), GFP_KERNEL);
+  if (!bos)
+    return -ENOMEM;
+
+  if (copy_from_user(bos, u64_to_user_ptr(args->bos),
+                     args->count * sizeof(*bos))) {
+    ret = -EFAULT;
+    goto free_bos;
+  }
+
+  for (i = 0; i < args->count; i++) {
+    ret = exsl_create_bos_one(dev, &bos[i], file);
+    if (ret) {
+      DRM_DEBUG("BO %u of %u failed: %d\n", i, args->count, ret);
+      break;
+    }
+  }
+
+  if (!ret && copy_to_user(u64_to_user_ptr(args->bos), bos,
+                           args->count * sizeof(*bos)))
+    ret = -EFAULT;
+
+  /* All or nothing: drop the handles of the BOs created so far */
+  if (ret)
+    while (i--)
+      drm_gem_handle_delete(file, bos[i].handle);
+
+free_bos:
+  kvfree(bos);
+  return ret;
+}
+
+static int32_t exsl_destroy_bos(struct drm_device *dev, void *data,
+                                struct drm_file *file) {
+  struct exsl_destroy_bos_args *args = data;
+  uint32_t *handles;
+  int32_t ret = 0;
+  uint32_t i;
+
+  if (args->pad || !args->count || args->count > EXSL_MAX_BO_BATCH)
+    return -EINVAL;
+
+  handles = memdup_user(u64_to_user_ptr(args->handles),
+                        args->count * sizeof(*handles));
+  if (IS_ERR(handles))
+    return PTR_ERR(handles);
+
+  for (i = 0; i < args->count; i++)
+    if (drm_gem_handle_delete(file, handles[i]))
+      ret = -ENOENT;
+
+  kfree(handles);
+  return ret;
+}
+
+/* BOs the CPU maps cacheable: cached CMA BOs and pinned user pages */
+static bool exslerate_gem_is_cacheable(struct exslerate_gem_obj *abo) {
+  return abo->base.map_noncoherent || abo->sgt;
+}
+
+/* Look up the BO of a CPU sync and check the range lies within it */
+static struct drm_gem_object *
+exsl_cpu_sync_lookup(struct drm_file *file, struct exsl_cpu_sync_args *args) {
+  struct drm_gem_object *gobj;
+  size_t bo_size;
+
+  if (args->pad || !args->flags ||
+      (args->flags & ~(EXSL_CPU_SYNC_READ | EXSL_CPU_SYNC_WRITE)))
+    return ERR_PTR(-EINVAL);
+
+  gobj = drm_gem_object_lookup(file, args->handle);
+  if (!gobj) {
+    DRM_ERROR("Failed to lookup GEM object %d\n", args->handle);
+    return ERR_PTR(-ENOENT);
+  }
+
+  bo_size = to_exsl_obj(gobj)->mem.size;
+  if (!args->size && args->offset < bo_size)
+    args->size = bo_size - args->offset;
+
+  if (args->offset >= bo_size || args->size > bo_size - args->offset) {
+    DRM_ERROR("CPU sync range 0x%llx+0x%llx outside BO of 0x%zx\n",
+              args->offset, args->size, bo_size);
+    drm_gem_object_put(gobj);
+    return ERR_PTR(-EINVAL);
+  }
+
+  return gobj;
+}
+
+static int32_t exsl_cpu_prep(struct drm_device *drm, void *data,
+                             struct drm_file *file) {
+  struct exsl_cpu_sync_args *args = data;
+  struct exslerate_gem_obj *abo;
+  struct drm_gem_object *gobj;
+  long timeout, ret;
+
+  gobj = exsl_cpu_sync_lookup(file, args);
+  if (IS_ERR(gobj))
+    return PTR_ERR(gobj);
+  abo = to_exsl_obj(gobj);
+
+  timeout = args->timeout_ms ? msecs_to_jiffies(args->timeout_ms)
+                             : MAX_SCHEDULE_TIMEOUT;
+  ret = dma_resv_wait_timeout(gobj->resv,
+                              !!(args->flags & EXSL_CPU_SYNC_WRITE), true,
+                              timeout);
+  if (ret == 0)
+    ret = -ETIME;
+  else if (ret > 0)
+    ret = 0;
+
+  /* Invalidate for writes too, a partial line write back would be stale */
+  if (!ret && exslerate_gem_is_cacheable(abo))
+    dma_sync_single_for_cpu(drm->dev, abo->mem.dev_addr + args->offset,
+                            args->size, DMA_BIDIRECTIONAL);
+
+  drm_gem_object_put(gobj);
+  return ret;
+}
+
+static int32_t exsl_cpu_fini(struct drm_device *drm, void *data,
+                             struct drm_file *file) {
+  struct exsl_cpu_sync_args *args = data;
+  struct exslerate_gem_obj *abo;
+  struct drm_gem_object *gobj;
+
+  gobj = exsl_cpu_sync_lookup(file, args);
+  if (IS_ERR(gobj))
+    return PTR_ERR(gobj);
+  abo = to_exsl_obj(gobj);
 
-  DRM_DEBUG("GEM handle %d: map_offset=0x%llx, dev_addr=0x%llx, vaddr=0x%llx\n",
-            args->handle, args->map_offset, args->dev_addr, args->vaddr);
+  if ((args->flags & EXSL_CPU_SYNC_WRITE) && exslerate_gem_is_cacheable(abo))
+    dma_sync_single_for_device(drm->dev, abo->mem.dev_addr + args->offset,
+                               args->size, DMA_BIDIRECTIONAL);
 
   drm_gem_object_put(gobj);
   return 0;
 }
 
+/* Legacy path: writes the configuration of the file's default context */
 static int32_t exsl_write_config(struct drm_device *drm, void *data,
                                  struct drm_file *file) {
-  struct exslerate_device *exsl_dev = drm->dev_private;
   struct exsl_write_config_args *args = data;
+  struct exslerate_hwctx *hwctx;
 
-  memcpy(&exsl_dev->conv_config, args, sizeof(*args));
+  hwctx = exslerate_hwctx_get(file, EXSLERATE_DEFAULT_HWCTX);
+  if (!hwctx)
+    return -ENOENT;
+
+  mutex_lock(&hwctx->config_lock);
+  memcpy(&hwctx->config, args, sizeof(*args));
+  mutex_unlock(&hwctx->config_lock);
   DRM_DEBUG("Conv config written\n");
 
+  exslerate_hwctx_put(hwctx);
   return 0;
 }
 
@@ -215,7 +1760,63 @@ static int32_t exsl_read_status(struct drm_device *drm, void *data,
   struct exslerate_device *exsl_dev = drm->dev_private;
   struct exsl_read_status_args *args = data;
 
-  args->status_value = reg_read(exsl_dev, 0xD8);
+  args->status_value = conv_core_status(exsl_dev);
+  return 0;
+}
+
+/*
+ * Run the default context's config through the job queue and wait for it
+ * to retire.
+ */
+static int32_t exsl_run_conv_sync(struct exslerate_device *exsl_dev,
+                                  struct drm_file *file) {
+  struct exslerate_layer_desc *desc;
+  struct exslerate_hwctx *hwctx;
+  struct exslerate_task *task;
+  uint64_t seq;
+  int32_t ret;
+
+  hwctx = exslerate_hwctx_get(file, EXSLERATE_DEFAULT_HWCTX);
+  if (!hwctx)
+    return -ENOENT;
+
+  task = exslerate_task_create(exsl_dev, file);
+  if (IS_ERR(task)) {
+    ret = PTR_ERR(task);
+    goto put_hwctx;
+  }
+
+  desc = exsl_hwctx_pack_config(hwctx);
+  if (IS_ERR(desc))
+    ret = PTR_ERR(desc);
+  else
+    ret = exslerate_task_set_desc(task, desc);
+  if (ret) {
+    exslerate_task_put(task);
+    goto put_hwctx;
+  }
+
+  ret = exslerate_task_push(hwctx, task, &seq);
+  exslerate_task_put(task);
+  if (!ret)
+    ret = exslerate_hwctx_wait(hwctx, seq, 0, NULL);
+
+put_hwctx:
+  exslerate_hwctx_put(hwctx);
+  return ret;
+}
+
+static int32_t exsl_engine_stats(struct drm_device *drm, void *data,
+                                 struct drm_file *file) {
+  struct exslerate_device *exsl_dev = drm->dev_private;
+  struct exsl_engine_stats_args *args = data;
+
+  if (args->core_type >= EXSLERATE_NUM_ENGINES || args->pad)
+    return -EINVAL;
+
+  exslerate_engine_stats(&exsl_dev->engines[args->core_type], &args->busy_ns,
+                         &args->job_count);
+  args->timestamp_ns = ktime_get_ns();
   return 0;
 }
 
@@ -226,9 +1827,9 @@ static int32_t exsl_program_core(struct drm_device *drm, void *data,
 
   switch (args->core_type) {
   case EXSL_CONV_CORE:
-    return program_conv_core(exsl_dev);
+    return exsl_run_conv_sync(exsl_dev, file);
   case EXSL_GEMM_CORE:
-    return program_gemm_core(exsl_dev);
+    return -EOPNOTSUPP;
   default:
     return -EINVAL;
   }
@@ -244,11 +1845,84 @@ static const struct drm_ioctl_desc exslerate_drm_ioctls[] = {
     DRM_IOCTL_DEF_DRV(EXSL_WRITE_CONFIG, exsl_write_config, DRM_RENDER_ALLOW),
     DRM_IOCTL_DEF_DRV(EXSL_READ_STATUS, exsl_read_status, DRM_RENDER_ALLOW),
     DRM_IOCTL_DEF_DRV(EXSL_PROGRAM_CORE, exsl_program_core, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_WAIT, exsl_wait, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_CREATE_HWCTX, exsl_create_hwctx, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_DESTROY_HWCTX, exsl_destroy_hwctx,
+                      DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_CONFIG_HWCTX, exsl_config_hwctx, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_CREATE_DESC, exsl_create_desc, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_DESTROY_DESC, exsl_destroy_desc, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_ENGINE_STATS, exsl_engine_stats, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_CPU_PREP, exsl_cpu_prep, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_CPU_FINI, exsl_cpu_fini, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_CREATE_BOS, exsl_create_bos, DRM_RENDER_ALLOW),
+    DRM_IOCTL_DEF_DRV(EXSL_DESTROY_BOS, exsl_destroy_bos, DRM_RENDER_ALLOW),
+};
+
+static int exslerate_drm_open(struct drm_device *drm, struct drm_file *file) {
+  return exslerate_file_open(drm->dev_private, file);
+}
+
+static void exslerate_drm_postclose(struct drm_device *drm,
+                                    struct drm_file *file) {
+  exslerate_file_close(file);
+}
+
+static int exslerate_debugfs_bo_cache(struct seq_file *m, void *data) {
+  struct drm_info_node *node = m->private;
+  struct exslerate_device *exsl_dev = node->minor->dev->dev_private;
+  struct exslerate_bo_cache *cache = &exsl_dev->bo_cache;
+
+  mutex_lock(&cache->lock);
+  seq_printf(m, "hits: %llu\n", cache->hits);
+  seq_printf(m, "misses: %llu\n", cache->misses);
+  seq_printf(m, "buffers: %u\n", cache->count);
+  seq_printf(m, "bytes: %zu\n", cache->size);
+  mutex_unlock(&cache->lock);
+  seq_printf(m, "cap: %u MiB\n", READ_ONCE(exslerate_bo_cache_mb));
+
+  return 0;
+}
+
+static int exslerate_debugfs_residency(struct seq_file *m, void *data) {
+  struct drm_info_node *node = m->private;
+  struct exslerate_device *exsl_dev = node->minor->dev->dev_private;
+  struct exslerate_residency *res = &exsl_dev->residency;
+
+  mutex_lock(&res->lock);
+  seq_printf(m, "resident: %zu\n", res->resident);
+  seq_printf(m, "evicted: %zu\n", res->evicted);
+  seq_printf(m, "evictions: %llu\n", res->evictions);
+  seq_printf(m, "restores: %llu\n", res->restores);
+  seq_printf(m, "restore_us: %llu\n", div_u64(res->restore_ns, 1000));
+  mutex_unlock(&res->lock);
+
+  return 0;
+}
+
+static const struct drm_info_list exslerate_debugfs_list[] = {
+    {"bo_cache", exslerate_debugfs_bo_cache, 0},
+    {"residency", exslerate_debugfs_residency, 0},
 };
 
+static void exslerate_debugfs_init(struct drm_minor *minor) {
+  drm_debugfs_create_files(exslerate_debugfs_list,
+                           ARRAY_SIZE(exslerate_debugfs_list),
+                           minor->debugfs_root, minor);
+}
+
 static struct drm_driver exslerate_drm_driver = {
-    .driver_features = DRIVER_GEM | DRIVER_RENDER,
+    .driver_features =
+        DRIVER_GEM | DRIVER_RENDER | DRIVER_SYNCOBJ | DRIVER_SYNCOBJ_TIMELINE,
+    .open = exslerate_drm_open,
+    .postclose = exslerate_drm_postclose,
     .gem_create_object = exslerate_gem_create_object_cb,
+    .prime_handle_to_fd = drm_gem_prime_handle_to_fd,
+    .prime_fd_to_handle = drm_gem_prime_fd_to_handle,
+    .gem_prime_import = exslerate_gem_prime_import,
+    .gem_prime_import_sg_table = exslerate_gem_prime_import_sg_table,
+    .gem_prime_mmap = drm_gem_prime_mmap,
+    .debugfs_init = exslerate_debugfs_init,
     .ioctls = exslerate_drm_ioctls,
     .num_ioctls = ARRAY_SIZE(exslerate_drm_ioctls),
     .fops = &exslerate_drm_fops,
@@ -271,8 +1945,33 @@ int32_t exslerate_drm_probe(struct exslerate_device *exsl_dev) {
   exsl_dev->drm = drm;
   drm->dev_private = exsl_dev;
 
+  err = exslerate_heap_init(exsl_dev);
+  if (err) {
+    drm_dev_put(drm);
+    return err;
+  }
+
+  err = exslerate_bo_cache_init(exsl_dev);
+  if (err) {
+    drm_dev_put(drm);
+    return err;
+  }
+
+  err = exslerate_residency_init(exsl_dev);
+  if (err) {
+    drm_dev_put(drm);
+    return err;
+  }
+
+  err = exslerate_sched_init(exsl_dev);
+  if (err) {
+    drm_dev_put(drm);
+    return err;
+  }
+
   err = drm_dev_register(drm, 0);
   if (err < 0) {
+    exslerate_sched_fini(exsl_dev);
     drm_dev_put(drm);
     return err;
   }
@@ -285,6 +1984,7 @@ EXPORT_SYMBOL(exslerate_drm_probe);
 void exslerate_drm_remove(struct exslerate_device *exsl_dev) {
   if (exsl_dev->drm) {
     drm_dev_unregister(exsl_dev->drm);
+    exslerate_sched_fini(exsl_dev);
     drm_dev_put(exsl_dev->drm);
     exsl_dev->drm = NULL;
   }
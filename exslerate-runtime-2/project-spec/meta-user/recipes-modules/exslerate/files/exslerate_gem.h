@@ -4,10 +4,18 @@
 #include <drm/drm_file.h>
 #include <drm/drm_gem.h>
 #include <drm/drm_gem_cma_helper.h>
+#include <drm/drm_mm.h>
 #include <linux/dma-buf.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/shrinker.h>
 
 struct exslerate_device;
 struct exslerate_client;
+struct exslerate_slab;
+
+/* dev_addr of a BO without a device mapping */
+#define EXSLERATE_INVALID_ADDR (0)
 
 struct exslerate_mem {
   u64 userptr;
@@ -18,6 +26,21 @@ struct exslerate_mem {
   u32 nr_pages;
 };
 
+/* Freed CMA buffers kept for reuse, bucketed by log2 of their page count */
+#define EXSLERATE_BO_CACHE_BUCKETS 16
+
+struct exslerate_bo_cache {
+  struct device *dev;
+  struct mutex lock; /* Protects everything below */
+  struct list_head buckets[EXSLERATE_BO_CACHE_BUCKETS];
+  struct list_head lru; /* Oldest first, trimmed by the cap and shrinker */
+  size_t size;          /* Bytes held */
+  uint32_t count;
+  uint64_t hits;
+  uint64_t misses;
+  struct shrinker shrinker;
+};
+
 #define BO_SUBMIT_PINNED BIT(0)
 #define BO_SUBMIT_LOCKED BIT(1)
 
@@ -28,6 +51,12 @@ struct exslerate_gem_obj {
   u64 flags;
   struct mutex lock;
   struct exslerate_mem mem;
+  struct drm_mm_node heap_node; /* Range of the device heap, EXSL_BO_DEV */
+  struct exslerate_slab *slab;  /* Slab of a sub-page BO */
+  uint32_t slab_index;
+  struct sg_table *sgt; /* DMA mapping of pinned user pages, EXSL_BO_USERPTR */
+  struct list_head lru_link; /* Residency LRU, EXSL_BO_FLAG_EVICTABLE */
+  void *swap;                /* Contents while evicted from the pool */
 };
 
 static inline struct exslerate_gem_obj *
@@ -39,6 +68,9 @@ to_exsl_obj(struct drm_gem_object *obj) {
 
 struct drm_gem_object *exslerate_gem_create_object_cb(struct drm_device *dev,
                                                       size_t size);
+size_t exslerate_bo_cache_trim(struct exslerate_bo_cache *cache, size_t size);
+void exslerate_gem_sync_for_device(struct drm_gem_object *gobj);
+void exslerate_gem_sync_for_cpu(struct drm_gem_object *gobj);
 int32_t exslerate_drm_probe(struct exslerate_device *exsl_dev);
 void exslerate_drm_remove(struct exslerate_device *exsl_dev);
 
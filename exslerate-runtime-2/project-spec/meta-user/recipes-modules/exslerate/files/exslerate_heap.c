@@ -0,0 +1,79 @@
+/* exslerate_heap.c - ExSLerate device heap sub-allocator */
+#include "exslerate_heap.h"
+#include "exslerate_drv.h"
+
+#include <drm/drm_managed.h>
+#include <drm/drm_print.h>
+#include <linux/dma-mapping.h>
+#include <linux/module.h>
+
+static uint32_t exslerate_dev_heap_mb;
+module_param_named(dev_heap_mb, exslerate_dev_heap_mb, uint, 0444);
+MODULE_PARM_DESC(dev_heap_mb,
+                 "Device heap carved out of the reserved pool for EXSL_BO_DEV "
+                 "buffers, in MiB (default 0, disabled)");
+
+/* Runs once the last BO is gone, with the DRM device */
+static void exslerate_heap_fini(struct drm_device *drm, void *data) {
+  struct exslerate_device *exsl_dev = data;
+  struct exslerate_heap *heap = &exsl_dev->heap;
+
+  drm_mm_takedown(&heap->mm);
+  dma_free_coherent(&exsl_dev->pdev->dev, heap->size, heap->kva,
+                    heap->dma_addr);
+  mutex_destroy(&heap->lock);
+}
+
+/*
+ * Carve the heap out of the reserved pool. Failing to get it is not fatal:
+ * the other BO types are still served from CMA.
+ */
+int32_t exslerate_heap_init(struct exslerate_device *exsl_dev) {
+  struct exslerate_heap *heap = &exsl_dev->heap;
+  size_t size = (size_t)exslerate_dev_heap_mb << 20;
+
+  heap->size = 0;
+  if (!size)
+    return 0;
+
+  heap->kva = dma_alloc_coherent(&exsl_dev->pdev->dev, size, &heap->dma_addr,
+                                 GFP_KERNEL);
+  if (!heap->kva) {
+    DRM_ERROR("Failed to allocate %u MiB device heap, EXSL_BO_DEV disabled\n",
+              exslerate_dev_heap_mb);
+    return 0;
+  }
+
+  heap->size = size;
+  mutex_init(&heap->lock);
+  drm_mm_init(&heap->mm, 0, size);
+
+  DRM_INFO("Device heap: %u MiB at %pad\n", exslerate_dev_heap_mb,
+           &heap->dma_addr);
+
+  return drmm_add_action_or_reset(exsl_dev->drm, exslerate_heap_fini,
+                                  exsl_dev);
+}
+
+/* Reserve a page aligned range of the heap. Its contents are not cleared. */
+int32_t exslerate_heap_alloc(struct exslerate_heap *heap,
+                             struct drm_mm_node *node, size_t size) {
+  int32_t ret;
+
+  if (!heap->size)
+    return -ENODEV;
+
+  mutex_lock(&heap->lock);
+  ret = drm_mm_insert_node_generic(&heap->mm, node, PAGE_ALIGN(size),
+                                   PAGE_SIZE, 0, DRM_MM_INSERT_BEST);
+  mutex_unlock(&heap->lock);
+
+  return ret;
+}
+
+void exslerate_heap_free(struct exslerate_heap *heap,
+                         struct drm_mm_node *node) {
+  mutex_lock(&heap->lock);
+  drm_mm_remove_node(node);
+  mutex_unlock(&heap->lock);
+}
@@ -0,0 +1,28 @@
+#ifndef _EXSLERATE_HEAP_H_
+#define _EXSLERATE_HEAP_H_
+
+#include <drm/drm_mm.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+
+struct exslerate_device;
+
+/*
+ * Carve-out from the reserved DMA pool, allocated once at probe, that
+ * EXSL_BO_DEV buffers are sub-allocated from.
+ */
+struct exslerate_heap {
+  void *kva;
+  dma_addr_t dma_addr;
+  size_t size;       /* 0 when the heap is disabled */
+  struct mutex lock; /* Protects mm */
+  struct drm_mm mm;  /* Offsets into the heap */
+};
+
+int32_t exslerate_heap_init(struct exslerate_device *exsl_dev);
+int32_t exslerate_heap_alloc(struct exslerate_heap *heap,
+                             struct drm_mm_node *node, size_t size);
+void exslerate_heap_free(struct exslerate_heap *heap,
+                         struct drm_mm_node *node);
+
+#endif /* _EXSLERATE_HEAP_H_ */
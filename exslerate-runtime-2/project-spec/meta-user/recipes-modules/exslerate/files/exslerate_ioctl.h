@@ -19,6 +19,17 @@
 #define DRM_EXSL_WRITE_CONFIG 0x04
 #define DRM_EXSL_READ_STATUS 0x05
 #define DRM_EXSL_PROGRAM_CORE 0x06
+#define DRM_EXSL_WAIT 0x07
+#define DRM_EXSL_CREATE_HWCTX 0x08
+#define DRM_EXSL_DESTROY_HWCTX 0x09
+#define DRM_EXSL_CONFIG_HWCTX 0x0A
+#define DRM_EXSL_CREATE_DESC 0x0B
+#define DRM_EXSL_DESTROY_DESC 0x0C
+#define DRM_EXSL_ENGINE_STATS 0x0D
+#define DRM_EXSL_CPU_PREP 0x0E
+#define DRM_EXSL_CPU_FINI 0x0F
+#define DRM_EXSL_CREATE_BOS 0x10
+#define DRM_EXSL_DESTROY_BOS 0x11
 
 #define EXSL_INVALID_BO_HANDLE (~0U)
 
@@ -38,9 +49,25 @@ struct exsl_dev_info {
   const struct exsl_dev_ops *ops;
 };
 
-/* Submit arguments */
+/*
+ * Submit arguments
+ *
+ * EXEC_BUF:   cmd_handles = __u32 BO handles used by the job's layers,
+ *             args = __u32 layer descriptor handles, run back to back in
+ *             the driver as one job with a single completion fence, or
+ *             arg_count = 0 to run the hardware context's current config.
+ * DEPENDENCY: cmd_handles = __u32 syncobj handles that later jobs wait on,
+ *             args = optional __u64 timeline point per handle (0 = binary).
+ * SIGNAL:     cmd_handles/args as for DEPENDENCY, signalled when the last
+ *             job submitted so far completes.
+ * seq is returned for waiting with DRM_IOCTL_EXSL_WAIT.
+ *
+ * An EXEC_BUF with EXSL_SUBMIT_EXT_RELOCS in ext_flags points ext to a
+ * struct exsl_submit_relocs.
+ */
 struct exsl_submit_args {
   __u64 ext;
+#define EXSL_SUBMIT_EXT_RELOCS (1 << 0)
   __u64 ext_flags;
   __u32 hwctx;
 #define EXSL_CMD_SUBMIT_EXEC_BUF 0
@@ -54,8 +81,72 @@ struct exsl_submit_args {
   __u64 seq;
 };
 
+/* Limits of one EXEC_BUF: layer descriptors in args and BOs in cmd_handles */
+#define EXSL_MAX_JOB_LAYERS 1024
+#define EXSL_MAX_JOB_HANDLES 256
+
+/*
+ * Relocation: when the layer runs, the driver writes the device address of
+ * cmd_handles[bo_index] plus offset into one address slot of the layer,
+ * replacing whatever the config put there. Configs that use relocations
+ * need no GEM_MMAP dev_addr, and the driver stays free to move the BOs.
+ * BOs reached only through read slots (all but LIFETIME and OUTPUT) get a
+ * shared implicit fence and wait only for the last writer; all other BOs of
+ * the job are fenced as written.
+ */
+struct exsl_reloc {
+  __u32 layer;    /* Index into the job's layers */
+  __u32 slot;     /* EXSL_RELOC_CONV_* */
+  __u32 bo_index; /* Index into cmd_handles */
+  __u32 pad;
+  __u64 offset; /* Byte offset in the BO */
+};
+
+/* Address slots of a conv layer */
+#define EXSL_RELOC_CONV_IFMAP 0     /* ifBaseAddr */
+#define EXSL_RELOC_CONV_FILTER 1    /* flBaseAddr */
+#define EXSL_RELOC_CONV_LIFETIME 2  /* lifetimeBaseAddr */
+#define EXSL_RELOC_CONV_BIAS 3      /* biasBaseAddr, EXSL_BO_FLAG_DMA32 BO */
+#define EXSL_RELOC_CONV_LUT 4       /* lutBaseAddr, EXSL_BO_FLAG_DMA32 BO */
+#define EXSL_RELOC_CONV_BN_BIAS 5   /* bnBiasBaseAddr */
+#define EXSL_RELOC_CONV_BN_WEIGHT 6 /* bnWeightBaseAddr */
+#define EXSL_RELOC_CONV_OUTPUT 7    /* OutputBaseAddr */
+
+struct exsl_submit_relocs {
+  __u64 relocs; /* User pointer to struct exsl_reloc[count] */
+  __u32 count;
+  __u32 pad;
+};
+
 /* GEM operations */
 struct exsl_drm_create_bo {
+/*
+ * Map the BO cacheable for the CPU. Only for SHARE, CMD and DMA BOs, which
+ * then come from the system CMA area; CPU access must be bracketed with
+ * CPU_PREP/CPU_FINI. Other BOs are mapped write-combined.
+ */
+#define EXSL_BO_FLAG_CACHED (1 << 0)
+/*
+ * Let the driver evict the BO to system memory when the reserved pool is
+ * full, e.g. for weights. Only for SHARE, CMD and DMA BOs without
+ * EXSL_BO_FLAG_CACHED. Its device address changes across eviction, so
+ * jobs must reach it through relocations; GEM_MMAP returns dev_addr 0 and
+ * it cannot be exported.
+ */
+#define EXSL_BO_FLAG_EVICTABLE (1 << 1)
+/*
+ * The device only reads the BO. Only for USERPTR BOs, whose pages are then
+ * pinned without write access, so read-only mappings can be wrapped. Jobs
+ * must reach it through read relocation slots.
+ */
+#define EXSL_BO_FLAG_READ_ONLY (1 << 2)
+/*
+ * Place the BO below 4 GiB, for the 32-bit EXSL_RELOC_CONV_BIAS and
+ * EXSL_RELOC_CONV_LUT slots. Only for SHARE, CMD and DMA BOs. A reserved
+ * pool above 4 GiB needs a second, low memory-region in the DT for these;
+ * without one, creating them fails with -ENODEV.
+ */
+#define EXSL_BO_FLAG_DMA32 (1 << 3)
   __u64 flags;
   __u64 vaddr;
   __u64 size;
@@ -63,8 +154,23 @@ struct exsl_drm_create_bo {
 #define EXSL_BO_SHARE 1    /* Regular BO shared between user and device */
 #define EXSL_BO_DEV_HEAP 2 /* Shared host memory to device as heap memory */
 #define EXSL_BO_DEV 3      /* Allocated from BO_DEV_HEAP */
+/*
+ * A DEV_HEAP BO maps the whole device heap and size returns the heap size;
+ * only the DRM master or CAP_SYS_ADMIN may create one. DEV BOs are cleared,
+ * page aligned ranges of the heap. The heap is off unless the dev_heap_mb
+ * module parameter sizes it, and both types then fail with -ENODEV.
+ * SHARE, CMD and DMA BOs of up to 2 KiB are packed into pages shared with
+ * other small BOs of the same file, aligned to their power of two size.
+ * Mapping one maps its page; GEM_MMAP returns its offset in that page.
+ * USERPTR BOs wrap page aligned user memory, which has to be contiguous in
+ * device address space (hugetlbfs, udmabuf). They cannot be mmapped.
+ * BOs exported with DRM_IOCTL_PRIME_HANDLE_TO_FD map to one DMA address
+ * without struct pages, so only importers that use sg_dma_address() alone
+ * (e.g. videobuf2-dma-contig) can attach; shmem-backed importers cannot.
+ */
 #define EXSL_BO_CMD 4      /* User and driver accessible BO */
 #define EXSL_BO_DMA 5      /* DRM GEM DMA BO */
+#define EXSL_BO_USERPTR 6  /* Pinned user memory at vaddr, used in place */
   __u64 type;
   __u32 handle;
 };
@@ -78,7 +184,7 @@ struct exsl_gem_create_args {
 struct exsl_gem_map_offset_args {
   __u32 handle;
   __u32 flags;
-  __u32 pad;        /* Reserved for alignment/future use */
+  __u32 offset;     /* Out: offset of the BO in its first mapped page */
   __u64 map_offset; /* mmap offset */
   __u64 vaddr;      /* Userspace Virt address (0 if unmapped) */
   __u64 dev_addr;   /* Device address */
@@ -88,6 +194,44 @@ struct exsl_gem_destroy_args {
   __u32 handle;
 };
 
+/*
+ * One BO of a CREATE_BOS batch: the CREATE_BO arguments followed by what
+ * GEM_MMAP returns for it.
+ */
+struct exsl_bo_batch_entry {
+  __u64 flags;      /* EXSL_BO_FLAG_* */
+  __u64 vaddr;      /* USERPTR address */
+  __u64 size;       /* In, and out for DEV_HEAP */
+  __u64 type;       /* EXSL_BO_* */
+  __u64 map_offset; /* Out: mmap offset */
+  __u64 dev_addr;   /* Out: device address, 0 for evictable BOs */
+  __u32 handle;     /* Out */
+  __u32 offset;     /* Out: offset of the BO in its first mapped page */
+};
+
+/* Most BOs one CREATE_BOS or DESTROY_BOS call takes */
+#define EXSL_MAX_BO_BATCH 1024
+
+/*
+ * Create and map count BOs in one call. It either creates all of them or,
+ * on the first failure, none; entries are only written back on success.
+ */
+struct exsl_create_bos_args {
+  __u64 bos; /* User pointer to struct exsl_bo_batch_entry[count] */
+  __u32 count;
+  __u32 pad;
+};
+
+/*
+ * Release count handles. Every handle is released even if some are
+ * invalid, which then fails the call with -ENOENT.
+ */
+struct exsl_destroy_bos_args {
+  __u64 handles; /* User pointer to __u32[count] */
+  __u32 count;
+  __u32 pad;
+};
+
 struct exsl_mem_handle {
   __u32 handle;
   __u32 flags;
@@ -191,8 +335,17 @@ struct exsl_write_config_args {
   __u32 stallEn;         /* Stall enable */
   __u32 stallCountValue; /* Stall count value */
 
+  /*
+   * Kernel width, 0 for a FILT_H x FILT_H kernel. Strides are stride along
+   * W and strideCY along H; strideCX (0 for stride) is the W step of the
+   * IACT RAM. The core has no dilation: see libexslerate for lowering it.
+   * Filters are FILT_SIZE bytes apart and their channel sets FILT_SIZE /
+   * CHANNEL_SETS, so FILT_H can apply just the leading rows of each.
+   */
+  __u32 FILT_W;
+
   /* Padding for future expansion */
-  __u32 reserved[8];
+  __u32 reserved[7];
 };
 
 /* Status read structure */
@@ -208,6 +361,80 @@ struct exsl_program_core_args {
   __u32 reserved[2];
 };
 
+/*
+ * Wait for a submitted job, by the seq returned from DRM_IOCTL_EXSL_SUBMIT.
+ * Timing is returned for jobs among the last 64 of the context, 0 otherwise.
+ */
+struct exsl_wait_args {
+  __u32 hwctx;
+  __u32 timeout_ms; /* 0 waits indefinitely */
+  __u64 seq;
+  __u64 busy_ns;     /* Out: time from kick to completion */
+  __u64 idle_gap_ns; /* Out: core idle time the driver spent before the kick */
+};
+
+/*
+ * Hardware context create/destroy. Every file owns context 0, which
+ * DRM_IOCTL_EXSL_WRITE_CONFIG and PROGRAM_CORE use.
+ */
+struct exsl_hwctx_args {
+  __u32 handle;
+  __u32 pad;
+};
+
+/* Set the layer configuration of a hardware context */
+struct exsl_config_hwctx_args {
+  __u32 handle;
+  __u32 pad;
+  __u64 config; /* User pointer to struct exsl_write_config_args */
+};
+
+/*
+ * Layer descriptor: a config validated and packed into its CSR image once,
+ * then referenced by handle from EXEC_BUF submits. All layers of one job
+ * must target the same core.
+ */
+struct exsl_create_desc_args {
+  __u64 config;    /* User pointer to struct exsl_write_config_args */
+  __u32 handle;    /* Returned descriptor handle */
+  __u32 core_type; /* EXSL_CONV_CORE; the GEMM core has no register map */
+};
+
+struct exsl_destroy_desc_args {
+  __u32 handle;
+  __u32 pad;
+};
+
+/*
+ * Bracket CPU access to [offset, offset + size) of a BO. CPU_PREP waits for
+ * device access to finish (the last write for READ, all access for WRITE)
+ * and invalidates the range of a cacheable BO. CPU_FINI writes the range
+ * back after a WRITE. Only the range is maintained, so sync what you touch.
+ */
+struct exsl_cpu_sync_args {
+  __u32 handle;
+#define EXSL_CPU_SYNC_READ (1 << 0)
+#define EXSL_CPU_SYNC_WRITE (1 << 1)
+  __u32 flags;
+  __u64 offset;
+  __u64 size;       /* 0 covers the rest of the BO */
+  __u32 timeout_ms; /* CPU_PREP only, 0 waits indefinitely */
+  __u32 pad;
+};
+
+/*
+ * Utilisation of one core since the driver loaded. Sampling twice and
+ * dividing the busy_ns delta by the timestamp_ns delta gives the load.
+ * Cores without a job queue, currently the GEMM core, return -EINVAL.
+ */
+struct exsl_engine_stats_args {
+  __u32 core_type;    /* EXSL_CONV_CORE */
+  __u32 pad;
+  __u64 busy_ns;      /* Out: time the core has spent running layers */
+  __u64 job_count;    /* Out: jobs retired */
+  __u64 timestamp_ns; /* Out: CLOCK_MONOTONIC time of the sample */
+};
+
 /* Memory access flags */
 #define EXSL_MEM_READ (1 << 0)
 #define EXSL_MEM_WRITE (1 << 1)
@@ -242,5 +469,32 @@ struct exsl_program_core_args {
 #define DRM_IOCTL_EXSL_PROGRAM_CORE                                            \
   DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_PROGRAM_CORE,                            \
           struct exsl_program_core_args)
+#define DRM_IOCTL_EXSL_WAIT                                                    \
+  DRM_IOWR(DRM_COMMAND_BASE + DRM_EXSL_WAIT, struct exsl_wait_args)
+#define DRM_IOCTL_EXSL_CREATE_HWCTX                                            \
+  DRM_IOWR(DRM_COMMAND_BASE + DRM_EXSL_CREATE_HWCTX, struct exsl_hwctx_args)
+#define DRM_IOCTL_EXSL_DESTROY_HWCTX                                           \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_DESTROY_HWCTX, struct exsl_hwctx_args)
+#define DRM_IOCTL_EXSL_CONFIG_HWCTX                                            \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_CONFIG_HWCTX,                            \
+          struct exsl_config_hwctx_args)
+#define DRM_IOCTL_EXSL_CREATE_DESC                                             \
+  DRM_IOWR(DRM_COMMAND_BASE + DRM_EXSL_CREATE_DESC,                            \
+           struct exsl_create_desc_args)
+#define DRM_IOCTL_EXSL_DESTROY_DESC                                            \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_DESTROY_DESC,                            \
+          struct exsl_destroy_desc_args)
+#define DRM_IOCTL_EXSL_ENGINE_STATS                                            \
+  DRM_IOWR(DRM_COMMAND_BASE + DRM_EXSL_ENGINE_STATS,                           \
+           struct exsl_engine_stats_args)
+#define DRM_IOCTL_EXSL_CPU_PREP                                                \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_CPU_PREP, struct exsl_cpu_sync_args)
+#define DRM_IOCTL_EXSL_CPU_FINI                                                \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_CPU_FINI, struct exsl_cpu_sync_args)
+#define DRM_IOCTL_EXSL_CREATE_BOS                                              \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_CREATE_BOS, struct exsl_create_bos_args)
+#define DRM_IOCTL_EXSL_DESTROY_BOS                                             \
+  DRM_IOW(DRM_COMMAND_BASE + DRM_EXSL_DESTROY_BOS,                             \
+          struct exsl_destroy_bos_args)
 
 #endif /* _EXSLERATE_IOCTL_H_ */
\ No newline at end of file
@@ -0,0 +1,251 @@
+/* exslerate_residency.c - ExSLerate BO eviction from the reserved pool */
+#include "exslerate_residency.h"
+#include "exslerate_drv.h"
+#include "exslerate_gem.h"
+
+#include <drm/drm_managed.h>
+#include <drm/drm_print.h>
+#include <drm/drm_vma_manager.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma-resv.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+
+/* Copy an idle BO out to system memory and give its pool range back */
+static int32_t exslerate_residency_swap_out(struct exslerate_residency *res,
+                                            struct exslerate_gem_obj *abo) {
+  struct drm_gem_object *gobj = to_gobj(abo);
+  size_t size = gobj->size;
+  void *swap;
+
+  swap = kvmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+  if (!swap)
+    return -ENOMEM;
+
+  /* Zap CPU mappings first; faulting them back in waits for our lock */
+  drm_vma_node_unmap(&gobj->vma_node, gobj->dev->anon_inode->i_mapping);
+  memcpy(swap, abo->base.vaddr, size);
+
+  dma_free_wc(gobj->dev->dev, size, abo->base.vaddr, abo->base.paddr);
+  abo->base.vaddr = NULL;
+  abo->base.paddr = 0;
+  abo->mem.kva = NULL;
+  abo->mem.dev_addr = EXSLERATE_INVALID_ADDR;
+  abo->swap = swap;
+
+  list_del_init(&abo->lru_link);
+  res->resident -= size;
+  res->evicted += size;
+  res->evictions++;
+  return 0;
+}
+
+/*
+ * Free at least @size bytes of the pool: idle cached buffers first, then
+ * idle evictable BOs, least recently used first. BOs whose reservation is
+ * held, e.g. by a submit that is validating them, are skipped. Returns the
+ * bytes freed. Called with the residency lock held.
+ */
+static size_t
+exslerate_residency_reclaim_locked(struct exslerate_residency *res,
+                                   size_t size) {
+  struct exslerate_gem_obj *abo, *tmp;
+  struct drm_gem_object *gobj;
+  size_t freed;
+
+  freed = exslerate_bo_cache_trim(&res->exsl_dev->bo_cache, size);
+
+  list_for_each_entry_safe(abo, tmp, &res->lru, lru_link) {
+    if (freed >= size)
+      break;
+
+    gobj = to_gobj(abo);
+    if (!dma_resv_trylock(gobj->resv))
+      continue;
+
+    if (dma_resv_test_signaled(gobj->resv, true) &&
+        !exslerate_residency_swap_out(res, abo))
+      freed += gobj->size;
+    dma_resv_unlock(gobj->resv);
+  }
+
+  if (freed)
+    DRM_DEBUG("Reclaimed 0x%zx bytes of the pool for 0x%zx\n", freed, size);
+
+  return freed;
+}
+
+size_t exslerate_residency_reclaim(struct exslerate_residency *res,
+                                   size_t size) {
+  size_t freed;
+
+  mutex_lock(&res->lock);
+  freed = exslerate_residency_reclaim_locked(res, size);
+  mutex_unlock(&res->lock);
+
+  return freed;
+}
+
+/* Back @abo with pool memory, reclaiming until it fits or nothing is left */
+static int32_t exslerate_residency_alloc(struct exslerate_residency *res,
+                                         struct exslerate_gem_obj *abo) {
+  struct drm_gem_object *gobj = to_gobj(abo);
+
+  for (;;) {
+    abo->base.vaddr = dma_alloc_wc(gobj->dev->dev, gobj->size,
+                                   &abo->base.paddr,
+                                   GFP_KERNEL | __GFP_NOWARN);
+    if (abo->base.vaddr)
+      break;
+
+    if (!exslerate_residency_reclaim_locked(res, gobj->size))
+      return -ENOMEM;
+  }
+
+  abo->mem.kva = abo->base.vaddr;
+  abo->mem.dev_addr = abo->base.paddr;
+  list_add_tail(&abo->lru_link, &res->lru);
+  res->resident += gobj->size;
+  return 0;
+}
+
+/* Copy an evicted BO back into the pool, most likely at a new address */
+static int32_t exslerate_residency_swap_in(struct exslerate_residency *res,
+                                           struct exslerate_gem_obj *abo) {
+  size_t size = to_gobj(abo)->size;
+  ktime_t start = ktime_get();
+  int32_t ret;
+
+  ret = exslerate_residency_alloc(res, abo);
+  if (ret) {
+    DRM_ERROR("No room in the pool to restore a BO of 0x%zx\n", size);
+    return ret;
+  }
+
+  memcpy(abo->base.vaddr, abo->swap, size);
+  kvfree(abo->swap);
+  abo->swap = NULL;
+
+  res->evicted -= size;
+  res->restores++;
+  res->restore_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+  return 0;
+}
+
+/* Allocate the pool backing of a new evictable BO, zeroed by the pool */
+int32_t exslerate_residency_add(struct exslerate_residency *res,
+                                struct exslerate_gem_obj *abo) {
+  int32_t ret;
+
+  mutex_lock(&res->lock);
+  ret = exslerate_residency_alloc(res, abo);
+  mutex_unlock(&res->lock);
+
+  return ret;
+}
+
+/* Release the backing of an evictable BO, wherever it currently is */
+void exslerate_residency_remove(struct exslerate_residency *res,
+                                struct exslerate_gem_obj *abo) {
+  struct drm_gem_object *gobj = to_gobj(abo);
+
+  mutex_lock(&res->lock);
+  if (abo->swap) {
+    kvfree(abo->swap);
+    abo->swap = NULL;
+    res->evicted -= gobj->size;
+  } else if (abo->base.vaddr) {
+    list_del_init(&abo->lru_link);
+    dma_free_wc(gobj->dev->dev, gobj->size, abo->base.vaddr,
+                abo->base.paddr);
+    abo->base.vaddr = NULL;
+    res->resident -= gobj->size;
+  }
+  mutex_unlock(&res->lock);
+}
+
+/*
+ * Make the evictable BOs of a job resident and mark them most recently
+ * used. Called at submit with the reservations of @bos held, so none of
+ * them can be evicted again before the job's fence is on them.
+ */
+int32_t exslerate_residency_validate(struct exslerate_residency *res,
+                                     struct drm_gem_object **bos,
+                                     uint32_t count) {
+  struct exslerate_gem_obj *abo;
+  int32_t ret = 0;
+  uint32_t i;
+
+  mutex_lock(&res->lock);
+  for (i = 0; i < count; i++) {
+    abo = to_exsl_obj(bos[i]);
+    if (!(abo->flags & EXSL_BO_FLAG_EVICTABLE))
+      continue;
+
+    if (abo->swap) {
+      ret = exslerate_residency_swap_in(res, abo);
+      if (ret)
+        break;
+    } else {
+      list_move_tail(&abo->lru_link, &res->lru);
+    }
+  }
+  mutex_unlock(&res->lock);
+
+  return ret;
+}
+
+/*
+ * CPU fault on a mapping of an evictable BO. The whole VMA is mapped at
+ * once, the BO being contiguous; eviction zaps it again.
+ */
+vm_fault_t exslerate_residency_fault(struct vm_fault *vmf) {
+  struct vm_area_struct *vma = vmf->vma;
+  struct drm_gem_object *gobj = vma->vm_private_data;
+  struct exslerate_device *exsl_dev = gobj->dev->dev_private;
+  struct exslerate_residency *res = &exsl_dev->residency;
+  struct exslerate_gem_obj *abo = to_exsl_obj(gobj);
+  unsigned long addr, pfn;
+  vm_fault_t ret = VM_FAULT_NOPAGE;
+
+  mutex_lock(&res->lock);
+  if (abo->swap) {
+    if (exslerate_residency_swap_in(res, abo)) {
+      mutex_unlock(&res->lock);
+      return VM_FAULT_OOM;
+    }
+  } else {
+    list_move_tail(&abo->lru_link, &res->lru);
+  }
+
+  /* No IOMMU, the pool's bus address is its physical address */
+  pfn = PHYS_PFN(abo->base.paddr) + vma->vm_pgoff -
+        drm_vma_node_start(&gobj->vma_node);
+  for (addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE) {
+    ret = vmf_insert_pfn(vma, addr, pfn++);
+    if (ret & VM_FAULT_ERROR)
+      break;
+  }
+  mutex_unlock(&res->lock);
+
+  return ret;
+}
+
+/* Runs once the last BO is gone, with the DRM device */
+static void exslerate_residency_fini(struct drm_device *drm, void *data) {
+  struct exslerate_residency *res = data;
+
+  WARN_ON(!list_empty(&res->lru));
+  mutex_destroy(&res->lock);
+}
+
+int32_t exslerate_residency_init(struct exslerate_device *exsl_dev) {
+  struct exslerate_residency *res = &exsl_dev->residency;
+
+  res->exsl_dev = exsl_dev;
+  mutex_init(&res->lock);
+  INIT_LIST_HEAD(&res->lru);
+
+  return drmm_add_action_or_reset(exsl_dev->drm, exslerate_residency_fini,
+                                  res);
+}
@@ -0,0 +1,42 @@
+#ifndef _EXSLERATE_RESIDENCY_H_
+#define _EXSLERATE_RESIDENCY_H_
+
+#include <drm/drm_gem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+
+struct exslerate_device;
+struct exslerate_gem_obj;
+
+/*
+ * Evictable BOs (EXSL_BO_FLAG_EVICTABLE), typically weights. They live in
+ * the reserved pool while resident; when the pool is full the least
+ * recently used idle ones are copied out to system memory, and copied back
+ * before the next job or CPU access that needs them.
+ */
+struct exslerate_residency {
+  struct exslerate_device *exsl_dev;
+  struct mutex lock;    /* Protects lru and the backing of evictable BOs */
+  struct list_head lru; /* Resident evictable BOs, least recently used first */
+  size_t resident;      /* Pool bytes held by evictable BOs */
+  size_t evicted;       /* System memory bytes held by evicted BOs */
+  uint64_t evictions;
+  uint64_t restores;
+  uint64_t restore_ns; /* Time spent copying BOs back into the pool */
+};
+
+int32_t exslerate_residency_init(struct exslerate_device *exsl_dev);
+int32_t exslerate_residency_add(struct exslerate_residency *res,
+                                struct exslerate_gem_obj *abo);
+void exslerate_residency_remove(struct exslerate_residency *res,
+                                struct exslerate_gem_obj *abo);
+size_t exslerate_residency_reclaim(struct exslerate_residency *res,
+                                   size_t size);
+int32_t exslerate_residency_validate(struct exslerate_residency *res,
+                                     struct drm_gem_object **bos,
+                                     uint32_t count);
+vm_fault_t exslerate_residency_fault(struct vm_fault *vmf);
+
+#endif /* _EXSLERATE_RESIDENCY_H_ */
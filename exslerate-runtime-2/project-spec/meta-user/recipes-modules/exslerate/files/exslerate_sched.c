@@ -0,0 +1,1279 @@
+/* exslerate_sched.c - ExSLerate job submission and scheduling */
+#include <drm/drm_gem.h>
+#include <drm/drm_print.h>
+#include <drm/drm_syncobj.h>
+#include <drm/gpu_scheduler.h>
+#include <linux/delay.h>
+#include <linux/dma-fence-array.h>
+#include <linux/dma-fence-chain.h>
+#include <linux/dma-fence.h>
+#include <linux/dma-resv.h>
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+
+#include "conv_engine.h"
+#include "exslerate_drv.h"
+#include "exslerate_sched.h"
+
+/* Completion polling interval while a job is on a core */
+#define EXSLERATE_POLL_MIN_US 10
+#define EXSLERATE_POLL_MAX_US 20
+
+static uint32_t exslerate_job_timeout_ms = 2000;
+module_param_named(job_timeout_ms, exslerate_job_timeout_ms, uint, 0444);
+MODULE_PARM_DESC(job_timeout_ms, "Job timeout in ms (default 2000)");
+
+static bool exslerate_pipeline = true;
+module_param_named(pipeline, exslerate_pipeline, bool, 0444);
+MODULE_PARM_DESC(pipeline,
+                 "Queue the next layer while one runs and kick it from the "
+                 "completion path (default true)");
+
+static const char *exslerate_fence_get_driver_name(struct dma_fence *fence) {
+  return DRIVER_NAME;
+}
+
+static const char *exslerate_fence_get_timeline_name(struct dma_fence *fence) {
+  return to_exsl_fence(fence)->engine->name;
+}
+
+static const struct dma_fence_ops exslerate_fence_ops = {
+    .get_driver_name = exslerate_fence_get_driver_name,
+    .get_timeline_name = exslerate_fence_get_timeline_name,
+};
+
+static struct dma_fence *
+exslerate_fence_create(struct exslerate_engine *engine) {
+  struct exslerate_fence *fence;
+
+  fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+  if (!fence)
+    return ERR_PTR(-ENOMEM);
+
+  fence->engine = engine;
+  dma_fence_init(&fence->base, &exslerate_fence_ops,
+                 &engine->exsl_dev->job_lock, engine->fence_context,
+                 ++engine->emit_seqno);
+
+  return &fence->base;
+}
+
+static void exslerate_task_release(struct kref *ref) {
+  struct exslerate_task *task = container_of(ref, struct exslerate_task, ref);
+  struct dma_fence *fence;
+  unsigned long index;
+  uint32_t i;
+
+  xa_for_each(&task->deps, index, fence) dma_fence_put(fence);
+  xa_destroy(&task->deps);
+
+  dma_fence_put(task->irq_fence);
+  kvfree(task->relocs);
+  bitmap_free(task->bo_reads);
+  if (task->descs) {
+    for (i = 0; i < task->desc_count; i++) {
+      if (task->descs[i])
+        exslerate_desc_put(task->descs[i]);
+    }
+    kvfree(task->descs);
+  }
+
+  if (task->bos) {
+    for (i = 0; i < task->bo_count; i++) {
+      if (task->bos[i])
+        drm_gem_object_put(task->bos[i]);
+    }
+    kvfree(task->bos);
+  }
+
+  kfree(task);
+}
+
+void exslerate_task_put(struct exslerate_task *task) {
+  kref_put(&task->ref, exslerate_task_release);
+}
+
+struct exslerate_task *exslerate_task_create(struct exslerate_device *exsl_dev,
+                                             struct drm_file *file) {
+  struct exslerate_task *task;
+
+  task = kzalloc(sizeof(*task), GFP_KERNEL);
+  if (!task)
+    return ERR_PTR(-ENOMEM);
+
+  kref_init(&task->ref);
+  task->exsl_dev = exsl_dev;
+  task->file = file;
+  xa_init_flags(&task->deps, XA_FLAGS_ALLOC);
+
+  return task;
+}
+
+int32_t exslerate_task_lookup_bos(struct exslerate_task *task,
+                                  void __user *handles, uint32_t count) {
+  /* On failure the partially filled array is released with the task */
+  task->bo_count = count;
+  return drm_gem_objects_lookup(task->file, handles, count, &task->bos);
+}
+
+/* Resolve the layer descriptors the job runs, in execution order */
+int32_t exslerate_task_lookup_descs(struct exslerate_task *task,
+                                    const uint32_t *handles, uint32_t count) {
+  uint32_t i;
+
+  task->descs = kvcalloc(count, sizeof(*task->descs), GFP_KERNEL);
+  if (!task->descs)
+    return -ENOMEM;
+  task->desc_count = count;
+
+  /* On failure the partially filled array is released with the task */
+  for (i = 0; i < count; i++) {
+    task->descs[i] = exslerate_desc_get(task->file, handles[i]);
+    if (!task->descs[i]) {
+      DRM_ERROR("Invalid layer descriptor handle %u\n", handles[i]);
+      return -ENOENT;
+    }
+
+    if (task->descs[i]->core_type != task->descs[0]->core_type) {
+      DRM_ERROR("Layers of one job must run on the same core\n");
+      return -EINVAL;
+    }
+  }
+  task->core_type = task->descs[0]->core_type;
+
+  return 0;
+}
+
+/* Run a single descriptor, taking over the caller's reference */
+int32_t exslerate_task_set_desc(struct exslerate_task *task,
+                                struct exslerate_layer_desc *desc) {
+  task->descs = kvcalloc(1, sizeof(*task->descs), GFP_KERNEL);
+  if (!task->descs) {
+    exslerate_desc_put(desc);
+    return -ENOMEM;
+  }
+
+  task->descs[0] = desc;
+  task->desc_count = 1;
+  task->core_type = desc->core_type;
+  return 0;
+}
+
+static int exslerate_reloc_cmp(const void *a, const void *b) {
+  const struct exsl_reloc *ra = a, *rb = b;
+
+  return ra->layer < rb->layer ? -1 : ra->layer > rb->layer;
+}
+
+/* Address slots the core writes through; the others are only read */
+static bool exslerate_reloc_writes(uint32_t slot) {
+  /* Partial sums are read back and rewritten */
+  return slot == EXSL_RELOC_CONV_LIFETIME || slot == EXSL_RELOC_CONV_OUTPUT;
+}
+
+/*
+ * Whether a 32-bit slot can point into @abo wherever it sits when the layer
+ * runs. Evictable BOs come back anywhere in the reserved pool.
+ */
+static bool exslerate_reloc_fits_32bit(struct exslerate_device *exsl_dev,
+                                       struct exslerate_gem_obj *abo) {
+  if (abo->flags & EXSL_BO_FLAG_EVICTABLE)
+    return exsl_dev->pool_end <= SZ_4G;
+
+  return abo->mem.dev_addr + abo->mem.size <= SZ_4G;
+}
+
+/*
+ * Check the relocations of a task whose BOs and layers are resolved, and
+ * take over @relocs. The BO addresses are read when each layer is
+ * programmed, so a BO may still move while the job is queued; only BOs
+ * that could never fit a 32-bit slot are refused here.
+ */
+int32_t exslerate_task_set_relocs(struct exslerate_task *task,
+                                  struct exsl_reloc *relocs, uint32_t count) {
+  struct exslerate_gem_obj *abo;
+  struct exsl_reloc *reloc;
+  uint32_t i;
+
+  for (i = 0; i < count; i++) {
+    reloc = &relocs[i];
+
+    if (reloc->pad || reloc->layer >= task->desc_count ||
+        reloc->slot >= CONV_NUM_ADDR_SLOTS ||
+        reloc->bo_index >= task->bo_count) {
+      DRM_ERROR("Invalid relocation %u: layer %u slot %u BO %u\n", i,
+                reloc->layer, reloc->slot, reloc->bo_index);
+      kvfree(relocs);
+      return -EINVAL;
+    }
+
+    /* Evicted BOs get an address back before the job is queued */
+    abo = to_exsl_obj(task->bos[reloc->bo_index]);
+    if ((abo->mem.dev_addr == EXSLERATE_INVALID_ADDR && !abo->swap) ||
+        reloc->offset >= abo->mem.size) {
+      DRM_ERROR("Relocation %u offset 0x%llx outside BO of 0x%zx\n", i,
+                reloc->offset, abo->mem.size);
+      kvfree(relocs);
+      return -EINVAL;
+    }
+
+    if (conv_slot_is_32bit(reloc->slot) &&
+        !exslerate_reloc_fits_32bit(task->exsl_dev, abo)) {
+      DRM_ERROR("Relocation %u to 32-bit slot %u needs a DMA32 BO\n", i,
+                reloc->slot);
+      kvfree(relocs);
+      return -EINVAL;
+    }
+  }
+
+  /*
+   * BOs only reached through read slots share their reservation with other
+   * readers. BOs without relocations may be written through raw addresses.
+   */
+  task->bo_reads = bitmap_zalloc(task->bo_count, GFP_KERNEL);
+  if (!task->bo_reads) {
+    kvfree(relocs);
+    return -ENOMEM;
+  }
+  for (i = 0; i < count; i++) {
+    if (!exslerate_reloc_writes(relocs[i].slot))
+      set_bit(relocs[i].bo_index, task->bo_reads);
+  }
+  for (i = 0; i < count; i++) {
+    if (exslerate_reloc_writes(relocs[i].slot))
+      clear_bit(relocs[i].bo_index, task->bo_reads);
+  }
+
+  sort(relocs, count, sizeof(*relocs), exslerate_reloc_cmp, NULL);
+  task->relocs = relocs;
+  task->reloc_count = count;
+  return 0;
+}
+
+/* Make the task wait on syncobj fences (timeline points when non-zero) */
+int32_t exslerate_task_add_syncobj_deps(struct exslerate_task *task,
+                                        const uint32_t *handles,
+                                        const uint64_t *points,
+                                        uint32_t count) {
+  struct dma_fence *fence;
+  uint32_t i;
+  int32_t ret;
+
+  for (i = 0; i < count; i++) {
+    ret = drm_syncobj_find_fence(task->file, handles[i],
+                                 points ? points[i] : 0, 0, &fence);
+    if (ret) {
+      DRM_ERROR("Failed to get fence of syncobj %u: %d\n", handles[i], ret);
+      return ret;
+    }
+
+    /* Takes over the fence reference */
+    ret = drm_gem_fence_array_add(&task->deps, fence);
+    if (ret)
+      return ret;
+  }
+
+  return 0;
+}
+
+static bool exslerate_task_reads_only(struct exslerate_task *task,
+                                      uint32_t index) {
+  return task->bo_reads && test_bit(index, task->bo_reads);
+}
+
+/*
+ * Queue a task on the context's entity for the core it runs on. The job
+ * waits on the implicit fences of every referenced BO and publishes its own
+ * finished fence on them, so back-to-back layers that share activations are
+ * ordered by the scheduler rather than by userspace. BOs the job only reads
+ * get a shared fence and wait only for the last writer, so jobs reading the
+ * same weights run concurrently. Returns the per-context sequence number in
+ * @seq.
+ */
+int32_t exslerate_task_push(struct exslerate_hwctx *hwctx,
+                            struct exslerate_task *task, uint64_t *seq) {
+  struct drm_sched_entity *entity;
+  struct ww_acquire_ctx acquire_ctx;
+  struct dma_fence *done_fence;
+  uint32_t slot, i;
+  int32_t ret;
+  bool read;
+
+  mutex_lock(&hwctx->lock);
+
+  /* Throttle once the oldest fence still in the ring has not retired */
+  slot = (hwctx->seq + 1) % EXSLERATE_MAX_PENDING;
+  if (hwctx->fences[slot]) {
+    ret = dma_fence_wait(hwctx->fences[slot], true);
+    if (ret)
+      goto unlock_ctx;
+  }
+
+  ret = drm_gem_lock_reservations(task->bos, task->bo_count, &acquire_ctx);
+  if (ret)
+    goto unlock_ctx;
+
+  for (i = 0; i < task->bo_count; i++) {
+    read = exslerate_task_reads_only(task, i);
+    if (!read && to_exsl_obj(task->bos[i])->flags & EXSL_BO_FLAG_READ_ONLY) {
+      DRM_ERROR("Job may write read-only BO %u\n", i);
+      ret = -EACCES;
+      goto unlock_resv;
+    }
+
+    ret = drm_gem_fence_array_add_implicit(&task->deps, task->bos[i], !read);
+    if (ret)
+      goto unlock_resv;
+
+    /* Room for the shared fence, added once the job is pushed */
+    if (read) {
+      ret = dma_resv_reserve_shared(task->bos[i]->resv, 1);
+      if (ret)
+        goto unlock_resv;
+    }
+  }
+
+  ret = exslerate_residency_validate(&hwctx->exsl_dev->residency, task->bos,
+                                     task->bo_count);
+  if (ret)
+    goto unlock_resv;
+
+  /* Write back what the CPU left in its caches for userptr BOs */
+  for (i = 0; i < task->bo_count; i++)
+    exslerate_gem_sync_for_device(task->bos[i]);
+
+  entity = &hwctx->entity[task->core_type];
+  ret = drm_sched_job_init(&task->base, entity, hwctx);
+  if (ret)
+    goto unlock_resv;
+
+  done_fence = dma_fence_get(&task->base.s_fence->finished);
+
+  /* Reference owned by the scheduler, dropped in free_job */
+  kref_get(&task->ref);
+  drm_sched_entity_push_job(&task->base, entity);
+
+  for (i = 0; i < task->bo_count; i++) {
+    if (exslerate_task_reads_only(task, i))
+      dma_resv_add_shared_fence(task->bos[i]->resv, done_fence);
+    else
+      dma_resv_add_excl_fence(task->bos[i]->resv, done_fence);
+  }
+
+  drm_gem_unlock_reservations(task->bos, task->bo_count, &acquire_ctx);
+
+  dma_fence_put(hwctx->last_fence[task->core_type]);
+  hwctx->last_fence[task->core_type] = dma_fence_get(done_fence);
+  dma_fence_put(hwctx->fences[slot]);
+  hwctx->fences[slot] = done_fence;
+  *seq = ++hwctx->seq;
+
+  mutex_unlock(&hwctx->lock);
+  return 0;
+
+unlock_resv:
+  drm_gem_unlock_reservations(task->bos, task->bo_count, &acquire_ctx);
+unlock_ctx:
+  mutex_unlock(&hwctx->lock);
+  return ret;
+}
+
+/*
+ * Fence covering the last job @hwctx queued on each engine. The engines run
+ * independently, so the last job queued is not necessarily the last to finish.
+ * Called with the context lock held.
+ */
+static struct dma_fence *
+exslerate_hwctx_last_fence(struct exslerate_hwctx *hwctx) {
+  struct dma_fence *fences[EXSLERATE_NUM_ENGINES], **array;
+  struct dma_fence_array *fence_array;
+  uint32_t i, count = 0;
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    if (hwctx->last_fence[i] && !dma_fence_is_signaled(hwctx->last_fence[i]))
+      fences[count++] = hwctx->last_fence[i];
+  }
+
+  if (!count)
+    return dma_fence_get_stub();
+  if (count == 1)
+    return dma_fence_get(fences[0]);
+
+  /* The array owns the fence pointer array and the references in it */
+  array = kmalloc_array(count, sizeof(*array), GFP_KERNEL);
+  if (!array)
+    return ERR_PTR(-ENOMEM);
+
+  for (i = 0; i < count; i++)
+    array[i] = dma_fence_get(fences[i]);
+
+  fence_array = dma_fence_array_create(count, array,
+                                       dma_fence_context_alloc(1), 1, false);
+  if (!fence_array) {
+    for (i = 0; i < count; i++)
+      dma_fence_put(array[i]);
+    kfree(array);
+    return ERR_PTR(-ENOMEM);
+  }
+
+  return &fence_array->base;
+}
+
+/*
+ * Install a fence covering every job queued on @hwctx so far in each
+ * syncobj, as a new timeline point where one is given. Returns the seq of the
+ * last job queued.
+ */
+int32_t exslerate_hwctx_signal_syncobjs(struct exslerate_hwctx *hwctx,
+                                        struct drm_file *file,
+                                        const uint32_t *handles,
+                                        const uint64_t *points, uint32_t count,
+                                        uint64_t *seq) {
+  struct dma_fence_chain **chains;
+  struct drm_syncobj **syncobjs;
+  struct dma_fence *fence;
+  uint32_t i;
+  int32_t ret = 0;
+
+  syncobjs = kcalloc(count, sizeof(*syncobjs), GFP_KERNEL);
+  chains = kcalloc(count, sizeof(*chains), GFP_KERNEL);
+  if (!syncobjs || !chains) {
+    ret = -ENOMEM;
+    goto out;
+  }
+
+  /* Resolve everything up front so a bad handle signals nothing */
+  for (i = 0; i < count; i++) {
+    syncobjs[i] = drm_syncobj_find(file, handles[i]);
+    if (!syncobjs[i]) {
+      DRM_ERROR("Invalid syncobj handle %u\n", handles[i]);
+      ret = -ENOENT;
+      goto out;
+    }
+
+    if (points && points[i]) {
+      chains[i] = dma_fence_chain_alloc();
+      if (!chains[i]) {
+        ret = -ENOMEM;
+        goto out;
+      }
+    }
+  }
+
+  mutex_lock(&hwctx->lock);
+  fence = exslerate_hwctx_last_fence(hwctx);
+  *seq = hwctx->seq;
+  mutex_unlock(&hwctx->lock);
+  if (IS_ERR(fence)) {
+    ret = PTR_ERR(fence);
+    goto out;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (chains[i]) {
+      drm_syncobj_add_point(syncobjs[i], chains[i], fence, points[i]);
+      chains[i] = NULL;
+    } else {
+      drm_syncobj_replace_fence(syncobjs[i], fence);
+    }
+  }
+
+  dma_fence_put(fence);
+
+out:
+  for (i = 0; syncobjs && chains && i < count; i++) {
+    dma_fence_chain_free(chains[i]);
+    if (syncobjs[i])
+      drm_syncobj_put(syncobjs[i]);
+  }
+  kfree(chains);
+  kfree(syncobjs);
+  return ret;
+}
+
+/* Core timing of a retired job, taken from the hardware fence behind it */
+static void exslerate_fence_timing(struct dma_fence *fence,
+                                   struct exslerate_job_timing *timing) {
+  struct drm_sched_fence *s_fence = to_drm_sched_fence(fence);
+  struct exslerate_fence *hw_fence;
+
+  /* Barrier jobs and jobs dropped by a reset have no hardware fence */
+  if (!s_fence || !s_fence->parent ||
+      s_fence->parent->ops != &exslerate_fence_ops)
+    return;
+
+  hw_fence = to_exsl_fence(s_fence->parent);
+  timing->busy_ns = ktime_to_ns(ktime_sub(hw_fence->end, hw_fence->start));
+  timing->idle_gap_ns = hw_fence->idle_gap_ns;
+}
+
+/*
+ * Wait for job @seq of @hwctx. @timing, when given, is filled in for jobs
+ * that are still in the fence ring and zeroed otherwise.
+ */
+int32_t exslerate_hwctx_wait(struct exslerate_hwctx *hwctx, uint64_t seq,
+                             uint32_t timeout_ms,
+                             struct exslerate_job_timing *timing) {
+  struct dma_fence *fence;
+  long timeout, ret;
+
+  if (timing)
+    memset(timing, 0, sizeof(*timing));
+
+  mutex_lock(&hwctx->lock);
+  if (!seq || seq > hwctx->seq) {
+    mutex_unlock(&hwctx->lock);
+    DRM_ERROR("Invalid job sequence number: %llu\n", seq);
+    return -EINVAL;
+  }
+
+  /* Anything older than the ring was waited on before its slot was reused */
+  if (hwctx->seq - seq >= EXSLERATE_MAX_PENDING) {
+    mutex_unlock(&hwctx->lock);
+    return 0;
+  }
+
+  fence = dma_fence_get(hwctx->fences[seq % EXSLERATE_MAX_PENDING]);
+  mutex_unlock(&hwctx->lock);
+
+  timeout = timeout_ms ? msecs_to_jiffies(timeout_ms) : MAX_SCHEDULE_TIMEOUT;
+  ret = dma_fence_wait_timeout(fence, true, timeout);
+  if (ret == 0)
+    ret = -ETIME;
+  else if (ret > 0)
+    ret = fence->error;
+
+  if (ret >= 0 && timing)
+    exslerate_fence_timing(fence, timing);
+
+  dma_fence_put(fence);
+  return ret;
+}
+
+static inline struct exslerate_engine *
+exslerate_task_engine(struct exslerate_task *task) {
+  return &task->exsl_dev->engines[task->core_type];
+}
+
+static inline struct exslerate_engine *
+to_exsl_engine(struct drm_gpu_scheduler *sched) {
+  return container_of(sched, struct exslerate_engine, sched);
+}
+
+static uint32_t exslerate_core_status(struct exslerate_engine *engine) {
+  return conv_core_status(engine->exsl_dev);
+}
+
+static void exslerate_core_stop(struct exslerate_engine *engine) {
+  conv_core_stop(engine->exsl_dev);
+}
+
+/*
+ * Copy the image of the layer @task is at into @image with the current
+ * device address of each relocated BO patched in. Returns the descriptor
+ * itself when the layer has no relocations.
+ */
+static const struct exslerate_layer_desc *
+exslerate_task_reloc_layer(struct exslerate_task *task,
+                           struct exslerate_layer_desc *image) {
+  const struct exslerate_layer_desc *desc = task->descs[task->layer];
+  const struct exsl_reloc *reloc;
+  uint64_t addr;
+  int32_t ret;
+
+  if (task->next_reloc >= task->reloc_count ||
+      task->relocs[task->next_reloc].layer != task->layer)
+    return desc;
+
+  image->core_type = desc->core_type;
+  image->conv = desc->conv;
+
+  for (; task->next_reloc < task->reloc_count; task->next_reloc++) {
+    reloc = &task->relocs[task->next_reloc];
+    if (reloc->layer != task->layer)
+      break;
+
+    addr = to_exsl_obj(task->bos[reloc->bo_index])->mem.dev_addr +
+           reloc->offset;
+    ret = conv_layer_set_addr(&image->conv, reloc->slot, addr);
+    if (ret)
+      return ERR_PTR(ret);
+  }
+
+  return image;
+}
+
+/* Program and start a layer image, with hw_lock held */
+static int32_t exslerate_core_program(struct exslerate_engine *engine,
+                                      const struct exslerate_layer_desc *desc) {
+  struct exslerate_device *exsl_dev = engine->exsl_dev;
+  int32_t ret;
+
+  ret = program_conv_core(exsl_dev, &desc->conv);
+  if (ret)
+    return ret;
+  conv_core_start(exsl_dev);
+
+  engine->layer_start = ktime_get();
+  if (!exsl_dev->irq)
+    queue_work(system_highpri_wq, &engine->done_work);
+
+  return 0;
+}
+
+/* Program and start the layer @task is at, with hw_lock held */
+static int32_t exslerate_core_run_layer(struct exslerate_engine *engine,
+                                        struct exslerate_task *task) {
+  const struct exslerate_layer_desc *desc;
+  struct exslerate_layer_desc image;
+
+  desc = exslerate_task_reloc_layer(task, &image);
+  if (IS_ERR(desc))
+    return PTR_ERR(desc);
+
+  return exslerate_core_program(engine, desc);
+}
+
+/* Rewind @task to its first layer and build that layer's image */
+static const struct exslerate_layer_desc *
+exslerate_task_first_layer(struct exslerate_task *task,
+                           struct exslerate_layer_desc *image) {
+  task->layer = 0;
+  task->next_reloc = 0;
+  return exslerate_task_reloc_layer(task, image);
+}
+
+/*
+ * Kick the first layer of @task on the idle core, with hw_lock held. @desc
+ * is the layer image from exslerate_task_first_layer(). Takes over the
+ * caller's task reference, which job_done drops.
+ */
+static void exslerate_core_kick(struct exslerate_engine *engine,
+                                struct exslerate_task *task,
+                                const struct exslerate_layer_desc *desc) {
+  struct exslerate_fence *hw_fence = to_exsl_fence(task->irq_fence);
+  ktime_t idle_from;
+  int32_t ret;
+
+  WRITE_ONCE(engine->task, task);
+
+  ret = IS_ERR(desc) ? PTR_ERR(desc) : exslerate_core_program(engine, desc);
+  if (ret) {
+    WRITE_ONCE(engine->task, NULL);
+    dma_fence_set_error(&task->base.s_fence->finished, ret);
+    dma_fence_set_error(task->irq_fence, ret);
+    dma_fence_signal(task->irq_fence);
+    exslerate_task_put(task);
+    return;
+  }
+
+  hw_fence->start = engine->layer_start;
+
+  /* Idle time the driver is responsible for, not time spent without work */
+  idle_from = ktime_after(task->ready, engine->last_done) ? task->ready :
+                                                            engine->last_done;
+  hw_fence->idle_gap_ns = ktime_to_ns(ktime_sub(hw_fence->start, idle_from));
+}
+
+static int32_t exslerate_status_to_err(struct exslerate_device *exsl_dev,
+                                       uint32_t status) {
+  if (status & STATUS_ERROR) {
+    exsl_dev->error_count++;
+    return -EIO;
+  }
+
+  if (status & STATUS_TIMEOUT) {
+    exsl_dev->timeout_count++;
+    return -ETIMEDOUT;
+  }
+
+  return 0;
+}
+
+/*
+ * Handle a completion reported by the engine's core. The next layer of a
+ * graph job is kicked straight away; otherwise the job is retired and a job
+ * queued behind it is kicked before the finished job is signalled, so the
+ * core restarts without waiting on the scheduler.
+ */
+static void exslerate_job_done(struct exslerate_engine *engine,
+                               uint32_t status, ktime_t done) {
+  struct exslerate_device *exsl_dev = engine->exsl_dev;
+  struct exslerate_task *task, *next;
+  struct exslerate_fence *hw_fence;
+  uint32_t i;
+  int32_t err;
+
+  mutex_lock(&engine->hw_lock);
+  task = engine->task;
+  if (!task) {
+    mutex_unlock(&engine->hw_lock);
+    return;
+  }
+
+  exslerate_core_stop(engine);
+  engine->busy_ns += ktime_to_ns(ktime_sub(done, engine->layer_start));
+  hw_fence = to_exsl_fence(task->irq_fence);
+  err = exslerate_status_to_err(exsl_dev, status);
+
+  if (!err && task->layer + 1 < task->desc_count) {
+    task->layer++;
+    err = exslerate_core_run_layer(engine, task);
+    hw_fence->idle_gap_ns += ktime_to_ns(ktime_sub(ktime_get(), done));
+    if (!err) {
+      mutex_unlock(&engine->hw_lock);
+      return;
+    }
+  }
+
+  WRITE_ONCE(engine->task, NULL);
+  engine->last_done = done;
+  engine->job_count++;
+  hw_fence->end = done;
+
+  next = engine->next_task;
+  engine->next_task = NULL;
+  if (next)
+    exslerate_core_kick(engine, next, engine->next_desc);
+  mutex_unlock(&engine->hw_lock);
+
+  task->hw_status = status;
+
+  /* Drop stale CPU cache lines before anyone waiting can read the output */
+  for (i = 0; i < task->bo_count; i++)
+    exslerate_gem_sync_for_cpu(task->bos[i]);
+
+  if (err) {
+    DRM_ERROR("%s job failed at layer %u/%u, status 0x%08x\n", engine->name,
+              task->layer + 1, task->desc_count, status);
+    exsl_dev->last_error_status = status;
+    dma_fence_set_error(&task->base.s_fence->finished, err);
+    dma_fence_set_error(task->irq_fence, err);
+  }
+
+  dma_fence_signal(task->irq_fence);
+  exslerate_task_put(task);
+}
+
+static void exslerate_done_work(struct work_struct *work) {
+  struct exslerate_engine *engine =
+      container_of(work, struct exslerate_engine, done_work);
+  uint32_t status;
+
+  for (;;) {
+    if (!READ_ONCE(engine->task))
+      return;
+
+    status = exslerate_core_status(engine);
+    if (status & STATUS_COMPLETE_MASK)
+      break;
+
+    usleep_range(EXSLERATE_POLL_MIN_US, EXSLERATE_POLL_MAX_US);
+  }
+
+  exslerate_job_done(engine, status, ktime_get());
+}
+
+/* The cores share one interrupt line; find the ones that completed */
+static irqreturn_t exslerate_irq_handler(int irq, void *data) {
+  struct exslerate_device *exsl_dev = data;
+  struct exslerate_engine *engine;
+  ktime_t now = ktime_get();
+  uint32_t status, i;
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    engine = &exsl_dev->engines[i];
+    if (!READ_ONCE(engine->task))
+      continue;
+
+    status = exslerate_core_status(engine);
+    if (!(status & STATUS_COMPLETE_MASK))
+      continue;
+
+    engine->irq_time = now;
+    WRITE_ONCE(engine->irq_status, status);
+    set_bit(i, &exsl_dev->irq_pending);
+  }
+
+  /* The line stays masked (IRQF_ONESHOT) until the thread stops the cores */
+  return READ_ONCE(exsl_dev->irq_pending) ? IRQ_WAKE_THREAD : IRQ_NONE;
+}
+
+static irqreturn_t exslerate_irq_thread(int irq, void *data) {
+  struct exslerate_device *exsl_dev = data;
+  struct exslerate_engine *engine;
+  uint32_t i;
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    if (!test_and_clear_bit(i, &exsl_dev->irq_pending))
+      continue;
+
+    engine = &exsl_dev->engines[i];
+    exslerate_job_done(engine, READ_ONCE(engine->irq_status),
+                       engine->irq_time);
+  }
+
+  return IRQ_HANDLED;
+}
+
+static struct dma_fence *
+exslerate_sched_dependency(struct drm_sched_job *sched_job,
+                           struct drm_sched_entity *s_entity) {
+  struct exslerate_task *task = to_exsl_task(sched_job);
+
+  if (!xa_empty(&task->deps))
+    return xa_erase(&task->deps, task->last_dep++);
+
+  return NULL;
+}
+
+static struct dma_fence *
+exslerate_sched_run_job(struct drm_sched_job *sched_job) {
+  struct exslerate_task *task = to_exsl_task(sched_job);
+  struct exslerate_engine *engine = exslerate_task_engine(task);
+  const struct exslerate_layer_desc *desc;
+  struct exslerate_layer_desc image;
+  struct dma_fence *fence;
+
+  if (unlikely(sched_job->s_fence->finished.error))
+    return NULL;
+
+  /* Barrier jobs only exist to hold back later jobs on their dependencies */
+  if (task->type != EXSL_CMD_SUBMIT_EXEC_BUF)
+    return NULL;
+
+  fence = exslerate_fence_create(engine);
+  if (IS_ERR(fence))
+    return fence;
+
+  dma_fence_put(task->irq_fence);
+  task->irq_fence = dma_fence_get(fence);
+  task->ready = ktime_get();
+
+  /*
+   * Reference held while the job is queued or on the core, dropped in
+   * job_done. With the pipeline enabled the scheduler hands over the next
+   * job while the core is still busy; its first layer image is built now,
+   * while the core runs, so job_done only has to write and kick it.
+   */
+  kref_get(&task->ref);
+  mutex_lock(&engine->hw_lock);
+  if (!engine->task) {
+    desc = exslerate_task_first_layer(task, &image);
+    exslerate_core_kick(engine, task, desc);
+  } else {
+    engine->next_task = task;
+    engine->next_desc = exslerate_task_first_layer(task, engine->next_image);
+  }
+  mutex_unlock(&engine->hw_lock);
+
+  return fence;
+}
+
+static void exslerate_task_abort(struct exslerate_task *task, int32_t err) {
+  dma_fence_set_error(task->irq_fence, err);
+  dma_fence_signal(task->irq_fence);
+  exslerate_task_put(task);
+}
+
+/* Drop the job on the core and the one queued behind it, leave the core idle */
+static void exslerate_engine_reset(struct exslerate_engine *engine) {
+  struct exslerate_device *exsl_dev = engine->exsl_dev;
+  struct exslerate_task *task, *next;
+
+  mutex_lock(&engine->hw_lock);
+  task = engine->task;
+  next = engine->next_task;
+  WRITE_ONCE(engine->task, NULL);
+  engine->next_task = NULL;
+  mutex_unlock(&engine->hw_lock);
+
+  if (exsl_dev->irq)
+    synchronize_irq(exsl_dev->irq);
+  cancel_work_sync(&engine->done_work);
+  exslerate_core_stop(engine);
+
+  conv_core_invalidate(exsl_dev);
+
+  if (task)
+    exslerate_task_abort(task, -ETIMEDOUT);
+  if (next)
+    exslerate_task_abort(next, -ECANCELED);
+}
+
+static enum drm_gpu_sched_stat
+exslerate_sched_timedout_job(struct drm_sched_job *sched_job) {
+  struct exslerate_engine *engine = to_exsl_engine(sched_job->sched);
+
+  DRM_ERROR("%s job timed out, status 0x%08x\n", engine->name,
+            exslerate_core_status(engine));
+
+  drm_sched_stop(&engine->sched, sched_job);
+  drm_sched_increase_karma(sched_job);
+
+  exslerate_engine_reset(engine);
+
+  drm_sched_resubmit_jobs(&engine->sched);
+  drm_sched_start(&engine->sched, true);
+
+  return DRM_GPU_SCHED_STAT_NOMINAL;
+}
+
+static void exslerate_sched_free_job(struct drm_sched_job *sched_job) {
+  struct exslerate_task *task = to_exsl_task(sched_job);
+
+  drm_sched_job_cleanup(sched_job);
+  exslerate_task_put(task);
+}
+
+static const struct drm_sched_backend_ops exslerate_sched_ops = {
+    .dependency = exslerate_sched_dependency,
+    .run_job = exslerate_sched_run_job,
+    .timedout_job = exslerate_sched_timedout_job,
+    .free_job = exslerate_sched_free_job,
+};
+
+static const char *const exslerate_engine_names[EXSLERATE_NUM_ENGINES] = {
+    [EXSL_CONV_CORE] = "exslerate_conv",
+};
+
+int32_t exslerate_sched_init(struct exslerate_device *exsl_dev) {
+  struct exslerate_engine *engine;
+  uint32_t i;
+  int32_t ret;
+
+  spin_lock_init(&exsl_dev->job_lock);
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    engine = &exsl_dev->engines[i];
+    engine->exsl_dev = exsl_dev;
+    engine->core_type = i;
+    engine->name = exslerate_engine_names[i];
+    engine->fence_context = dma_fence_context_alloc(1);
+    mutex_init(&engine->hw_lock);
+    INIT_WORK(&engine->done_work, exslerate_done_work);
+
+    engine->next_image = devm_kzalloc(&exsl_dev->pdev->dev,
+                                      sizeof(*engine->next_image), GFP_KERNEL);
+    if (!engine->next_image)
+      return -ENOMEM;
+  }
+
+  if (exsl_dev->irq) {
+    ret = devm_request_threaded_irq(&exsl_dev->pdev->dev, exsl_dev->irq,
+                                    exslerate_irq_handler, exslerate_irq_thread,
+                                    IRQF_ONESHOT, DRIVER_NAME, exsl_dev);
+    if (ret) {
+      DRM_ERROR("Failed to request IRQ %d: %d\n", exsl_dev->irq, ret);
+      return ret;
+    }
+  }
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    engine = &exsl_dev->engines[i];
+    ret = drm_sched_init(&engine->sched, &exslerate_sched_ops,
+                         exslerate_pipeline ? 2 : 1, 0,
+                         msecs_to_jiffies(exslerate_job_timeout_ms), NULL,
+                         NULL, engine->name);
+    if (ret) {
+      DRM_ERROR("Failed to create %s scheduler: %d\n", engine->name, ret);
+      goto fini_scheds;
+    }
+  }
+
+  return 0;
+
+fini_scheds:
+  while (i--)
+    drm_sched_fini(&exsl_dev->engines[i].sched);
+  return ret;
+}
+
+void exslerate_sched_fini(struct exslerate_device *exsl_dev) {
+  struct exslerate_engine *engine;
+  uint32_t i;
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    engine = &exsl_dev->engines[i];
+    drm_sched_fini(&engine->sched);
+    cancel_work_sync(&engine->done_work);
+  }
+}
+
+/*
+ * Time the engine's core has spent running layers, including the layer on
+ * it now, and the number of jobs it has retired.
+ */
+void exslerate_engine_stats(struct exslerate_engine *engine, uint64_t *busy_ns,
+                            uint64_t *job_count) {
+  mutex_lock(&engine->hw_lock);
+  *busy_ns = engine->busy_ns;
+  if (engine->task)
+    *busy_ns += ktime_to_ns(ktime_sub(ktime_get(), engine->layer_start));
+  *job_count = engine->job_count;
+  mutex_unlock(&engine->hw_lock);
+}
+
+static void exslerate_desc_release(struct kref *ref) {
+  kfree(container_of(ref, struct exslerate_layer_desc, ref));
+}
+
+void exslerate_desc_put(struct exslerate_layer_desc *desc) {
+  kref_put(&desc->ref, exslerate_desc_release);
+}
+
+/*
+ * Validate @config, a struct exsl_write_config_args for the conv core, and
+ * pack it into a new, unnamed layer descriptor.
+ */
+struct exslerate_layer_desc *
+exslerate_desc_alloc(struct exslerate_device *exsl_dev, uint32_t core_type,
+                     const void *config) {
+  struct exslerate_layer_desc *desc;
+  int32_t ret;
+
+  desc = kmalloc(sizeof(*desc), GFP_KERNEL);
+  if (!desc)
+    return ERR_PTR(-ENOMEM);
+
+  desc->core_type = core_type;
+  switch (core_type) {
+  case EXSL_CONV_CORE:
+    ret = conv_layer_pack(exsl_dev, config, &desc->conv);
+    break;
+  default:
+    ret = -EINVAL;
+    break;
+  }
+  if (ret) {
+    kfree(desc);
+    return ERR_PTR(ret);
+  }
+
+  kref_init(&desc->ref);
+  return desc;
+}
+
+/* Look up a descriptor of @file, taking a reference the caller must put */
+struct exslerate_layer_desc *exslerate_desc_get(struct drm_file *file,
+                                                uint32_t handle) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_layer_desc *desc;
+
+  xa_lock(&fpriv->desc_xa);
+  desc = xa_load(&fpriv->desc_xa, handle);
+  if (desc)
+    kref_get(&desc->ref);
+  xa_unlock(&fpriv->desc_xa);
+
+  return desc;
+}
+
+int32_t exslerate_desc_create(struct drm_file *file, uint32_t core_type,
+                              const void *config, uint32_t *handle) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_layer_desc *desc;
+  int32_t ret;
+
+  desc = exslerate_desc_alloc(fpriv->exsl_dev, core_type, config);
+  if (IS_ERR(desc))
+    return PTR_ERR(desc);
+
+  ret = xa_alloc(&fpriv->desc_xa, handle, desc, xa_limit_32b, GFP_KERNEL);
+  if (ret) {
+    DRM_ERROR("Failed to allocate layer descriptor: %d\n", ret);
+    exslerate_desc_put(desc);
+  }
+
+  return ret;
+}
+
+/* Jobs already queued keep their own reference to the descriptor */
+int32_t exslerate_desc_destroy(struct drm_file *file, uint32_t handle) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_layer_desc *desc;
+
+  desc = xa_erase(&fpriv->desc_xa, handle);
+  if (!desc)
+    return -ENOENT;
+
+  exslerate_desc_put(desc);
+  return 0;
+}
+
+static void exslerate_hwctx_release(struct kref *ref) {
+  struct exslerate_hwctx *hwctx =
+      container_of(ref, struct exslerate_hwctx, ref);
+  uint32_t i;
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    drm_sched_entity_destroy(&hwctx->entity[i]);
+    dma_fence_put(hwctx->last_fence[i]);
+  }
+
+  for (i = 0; i < EXSLERATE_MAX_PENDING; i++)
+    dma_fence_put(hwctx->fences[i]);
+
+  mutex_destroy(&hwctx->config_lock);
+  mutex_destroy(&hwctx->lock);
+  kfree(hwctx);
+}
+
+void exslerate_hwctx_put(struct exslerate_hwctx *hwctx) {
+  kref_put(&hwctx->ref, exslerate_hwctx_release);
+}
+
+static struct exslerate_hwctx *
+exslerate_hwctx_alloc(struct exslerate_device *exsl_dev) {
+  struct drm_gpu_scheduler *sched;
+  struct exslerate_hwctx *hwctx;
+  uint32_t i;
+  int32_t ret;
+
+  hwctx = kzalloc(sizeof(*hwctx), GFP_KERNEL);
+  if (!hwctx)
+    return ERR_PTR(-ENOMEM);
+
+  kref_init(&hwctx->ref);
+  hwctx->exsl_dev = exsl_dev;
+  mutex_init(&hwctx->lock);
+  mutex_init(&hwctx->config_lock);
+
+  for (i = 0; i < EXSLERATE_NUM_ENGINES; i++) {
+    sched = &exsl_dev->engines[i].sched;
+    ret = drm_sched_entity_init(&hwctx->entity[i], DRM_SCHED_PRIORITY_NORMAL,
+                                &sched, 1, NULL);
+    if (ret)
+      break;
+  }
+  if (ret) {
+    while (i--)
+      drm_sched_entity_destroy(&hwctx->entity[i]);
+    mutex_destroy(&hwctx->config_lock);
+    mutex_destroy(&hwctx->lock);
+    kfree(hwctx);
+    return ERR_PTR(ret);
+  }
+
+  return hwctx;
+}
+
+/* Look up a context of @file, taking a reference the caller must put */
+struct exslerate_hwctx *exslerate_hwctx_get(struct drm_file *file,
+                                            uint32_t handle) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_hwctx *hwctx;
+
+  xa_lock(&fpriv->hwctx_xa);
+  hwctx = xa_load(&fpriv->hwctx_xa, handle);
+  if (hwctx)
+    kref_get(&hwctx->ref);
+  xa_unlock(&fpriv->hwctx_xa);
+
+  return hwctx;
+}
+
+int32_t exslerate_hwctx_create(struct drm_file *file, uint32_t *handle) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_hwctx *hwctx;
+  int32_t ret;
+
+  hwctx = exslerate_hwctx_alloc(fpriv->exsl_dev);
+  if (IS_ERR(hwctx))
+    return PTR_ERR(hwctx);
+
+  ret = xa_alloc(&fpriv->hwctx_xa, handle, hwctx,
+                 XA_LIMIT(1, EXSLERATE_MAX_HWCTX), GFP_KERNEL);
+  if (ret) {
+    DRM_ERROR("Failed to allocate hardware context: %d\n", ret);
+    exslerate_hwctx_put(hwctx);
+  }
+
+  return ret;
+}
+
+int32_t exslerate_hwctx_destroy(struct drm_file *file, uint32_t handle) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_hwctx *hwctx;
+
+  /* The default context lives as long as the file */
+  if (handle == EXSLERATE_DEFAULT_HWCTX)
+    return -EINVAL;
+
+  hwctx = xa_erase(&fpriv->hwctx_xa, handle);
+  if (!hwctx)
+    return -ENOENT;
+
+  exslerate_hwctx_put(hwctx);
+  return 0;
+}
+
+int32_t exslerate_file_open(struct exslerate_device *exsl_dev,
+                            struct drm_file *file) {
+  struct exslerate_file_priv *fpriv;
+  struct exslerate_hwctx *hwctx;
+  int32_t ret;
+
+  fpriv = kzalloc(sizeof(*fpriv), GFP_KERNEL);
+  if (!fpriv)
+    return -ENOMEM;
+
+  fpriv->exsl_dev = exsl_dev;
+  xa_init_flags(&fpriv->hwctx_xa, XA_FLAGS_ALLOC);
+  xa_init_flags(&fpriv->desc_xa, XA_FLAGS_ALLOC1);
+
+  fpriv->slab_pool = exslerate_slab_pool_create(&exsl_dev->pdev->dev);
+  if (IS_ERR(fpriv->slab_pool)) {
+    ret = PTR_ERR(fpriv->slab_pool);
+    goto free_fpriv;
+  }
+
+  hwctx = exslerate_hwctx_alloc(exsl_dev);
+  if (IS_ERR(hwctx)) {
+    ret = PTR_ERR(hwctx);
+    goto put_slab_pool;
+  }
+
+  ret = xa_err(xa_store(&fpriv->hwctx_xa, EXSLERATE_DEFAULT_HWCTX, hwctx,
+                        GFP_KERNEL));
+  if (ret) {
+    exslerate_hwctx_put(hwctx);
+    goto put_slab_pool;
+  }
+
+  file->driver_priv = fpriv;
+  return 0;
+
+put_slab_pool:
+  exslerate_slab_pool_put(fpriv->slab_pool);
+free_fpriv:
+  xa_destroy(&fpriv->hwctx_xa);
+  kfree(fpriv);
+  return ret;
+}
+
+void exslerate_file_close(struct drm_file *file) {
+  struct exslerate_file_priv *fpriv = file->driver_priv;
+  struct exslerate_layer_desc *desc;
+  struct exslerate_hwctx *hwctx;
+  unsigned long handle;
+
+  xa_for_each(&fpriv->hwctx_xa, handle, hwctx) {
+    xa_erase(&fpriv->hwctx_xa, handle);
+    exslerate_hwctx_put(hwctx);
+  }
+  xa_destroy(&fpriv->hwctx_xa);
+
+  xa_for_each(&fpriv->desc_xa, handle, desc) {
+    xa_erase(&fpriv->desc_xa, handle);
+    exslerate_desc_put(desc);
+  }
+  xa_destroy(&fpriv->desc_xa);
+
+  /* Small BOs still referenced elsewhere keep the pool alive */
+  exslerate_slab_pool_put(fpriv->slab_pool);
+  kfree(fpriv);
+}
@@ -0,0 +1,123 @@
+#ifndef _EXSLERATE_SCHED_H_
+#define _EXSLERATE_SCHED_H_
+
+#include <drm/drm_file.h>
+#include <drm/gpu_scheduler.h>
+#include <linux/dma-fence.h>
+#include <linux/mutex.h>
+
+#include "conv_engine.h"
+#include "exslerate_drv.h"
+#include "exslerate_slab.h"
+
+/* Number of submitted jobs per context whose fences can be waited on by seq */
+#define EXSLERATE_MAX_PENDING 64
+
+/* Layers a single graph job may chain, and BOs/syncobjs per submit */
+#define EXSLERATE_MAX_GRAPH_LAYERS EXSL_MAX_JOB_LAYERS
+#define EXSLERATE_MAX_JOB_HANDLES EXSL_MAX_JOB_HANDLES
+#define EXSLERATE_MAX_JOB_RELOCS (EXSLERATE_MAX_GRAPH_LAYERS * 8)
+
+/* Context every file starts with, targeted by DRM_IOCTL_EXSL_WRITE_CONFIG */
+#define EXSLERATE_DEFAULT_HWCTX 0
+#define EXSLERATE_MAX_HWCTX 32
+
+/* Hardware fence for a job running on one of the cores */
+struct exslerate_fence {
+  struct dma_fence base;
+  struct exslerate_engine *engine;
+  ktime_t start;       /* Kick */
+  ktime_t end;         /* Completion seen by the driver */
+  int64_t idle_gap_ns; /* Idle core time before the kick */
+};
+
+/* Per-job timing returned by DRM_IOCTL_EXSL_WAIT */
+struct exslerate_job_timing {
+  uint64_t busy_ns;
+  uint64_t idle_gap_ns;
+};
+
+static inline struct exslerate_fence *to_exsl_fence(struct dma_fence *fence) {
+  return container_of(fence, struct exslerate_fence, base);
+}
+
+/* Hardware context: a job queue with its own layer configuration */
+struct exslerate_hwctx {
+  struct kref ref;
+  struct exslerate_device *exsl_dev;
+  struct drm_sched_entity entity[EXSLERATE_NUM_ENGINES];
+  struct mutex lock; /* Serialises job init/push and the fence ring */
+  uint64_t seq;      /* Last sequence number handed out, on any engine */
+  struct dma_fence *fences[EXSLERATE_MAX_PENDING];
+  struct dma_fence *last_fence[EXSLERATE_NUM_ENGINES];
+
+  struct mutex config_lock; /* Protects config */
+  struct exsl_write_config_args config;
+};
+
+/* Layer validated and packed once, shared by every job that runs it */
+struct exslerate_layer_desc {
+  struct kref ref;
+  uint32_t core_type; /* EXSL_CONV_CORE */
+  struct conv_layer_regs conv;
+};
+
+/* Per drm_file state */
+struct exslerate_file_priv {
+  struct exslerate_device *exsl_dev;
+  struct xarray hwctx_xa; /* Handle -> struct exslerate_hwctx */
+  struct xarray desc_xa;  /* Handle -> struct exslerate_layer_desc */
+  struct exslerate_slab_pool *slab_pool; /* Backs sub-page BOs */
+};
+
+int32_t exslerate_sched_init(struct exslerate_device *exsl_dev);
+void exslerate_sched_fini(struct exslerate_device *exsl_dev);
+void exslerate_engine_stats(struct exslerate_engine *engine, uint64_t *busy_ns,
+                            uint64_t *job_count);
+
+int32_t exslerate_file_open(struct exslerate_device *exsl_dev,
+                            struct drm_file *file);
+void exslerate_file_close(struct drm_file *file);
+
+struct exslerate_hwctx *exslerate_hwctx_get(struct drm_file *file,
+                                            uint32_t handle);
+void exslerate_hwctx_put(struct exslerate_hwctx *hwctx);
+int32_t exslerate_hwctx_create(struct drm_file *file, uint32_t *handle);
+int32_t exslerate_hwctx_destroy(struct drm_file *file, uint32_t handle);
+
+struct exslerate_layer_desc *
+exslerate_desc_alloc(struct exslerate_device *exsl_dev, uint32_t core_type,
+                     const void *config);
+struct exslerate_layer_desc *exslerate_desc_get(struct drm_file *file,
+                                                uint32_t handle);
+void exslerate_desc_put(struct exslerate_layer_desc *desc);
+int32_t exslerate_desc_create(struct drm_file *file, uint32_t core_type,
+                              const void *config, uint32_t *handle);
+int32_t exslerate_desc_destroy(struct drm_file *file, uint32_t handle);
+
+struct exslerate_task *exslerate_task_create(struct exslerate_device *exsl_dev,
+                                             struct drm_file *file);
+void exslerate_task_put(struct exslerate_task *task);
+int32_t exslerate_task_lookup_bos(struct exslerate_task *task,
+                                  void __user *handles, uint32_t count);
+int32_t exslerate_task_lookup_descs(struct exslerate_task *task,
+                                    const uint32_t *handles, uint32_t count);
+int32_t exslerate_task_set_desc(struct exslerate_task *task,
+                                struct exslerate_layer_desc *desc);
+int32_t exslerate_task_set_relocs(struct exslerate_task *task,
+                                  struct exsl_reloc *relocs, uint32_t count);
+int32_t exslerate_task_add_syncobj_deps(struct exslerate_task *task,
+                                        const uint32_t *handles,
+                                        const uint64_t *points, uint32_t count);
+int32_t exslerate_task_push(struct exslerate_hwctx *hwctx,
+                            struct exslerate_task *task, uint64_t *seq);
+int32_t exslerate_hwctx_signal_syncobjs(struct exslerate_hwctx *hwctx,
+                                        struct drm_file *file,
+                                        const uint32_t *handles,
+                                        const uint64_t *points, uint32_t count,
+                                        uint64_t *seq);
+int32_t exslerate_hwctx_wait(struct exslerate_hwctx *hwctx, uint64_t seq,
+                             uint32_t timeout_ms,
+                             struct exslerate_job_timing *timing);
+
+#endif /* _EXSLERATE_SCHED_H_ */
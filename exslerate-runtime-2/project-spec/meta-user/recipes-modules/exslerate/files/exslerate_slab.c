@@ -0,0 +1,119 @@
+/* exslerate_slab.c - ExSLerate small-object slab for sub-page BOs */
+#include "exslerate_slab.h"
+
+#include <drm/drm_print.h>
+#include <linux/dma-mapping.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+
+struct exslerate_slab_pool *exslerate_slab_pool_create(struct device *dev) {
+  struct exslerate_slab_pool *pool;
+  uint32_t i;
+
+  pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+  if (!pool)
+    return ERR_PTR(-ENOMEM);
+
+  kref_init(&pool->ref);
+  pool->dev = dev;
+  mutex_init(&pool->lock);
+  for (i = 0; i < EXSLERATE_SLAB_CLASSES; i++)
+    INIT_LIST_HEAD(&pool->slabs[i]);
+
+  return pool;
+}
+
+/* Every object has been freed by now, so every slab is already gone */
+static void exslerate_slab_pool_release(struct kref *ref) {
+  struct exslerate_slab_pool *pool =
+      container_of(ref, struct exslerate_slab_pool, ref);
+
+  mutex_destroy(&pool->lock);
+  kfree(pool);
+}
+
+void exslerate_slab_pool_put(struct exslerate_slab_pool *pool) {
+  kref_put(&pool->ref, exslerate_slab_pool_release);
+}
+
+static struct exslerate_slab *
+exslerate_slab_create(struct exslerate_slab_pool *pool, uint32_t obj_size) {
+  struct exslerate_slab *slab;
+
+  slab = kzalloc(sizeof(*slab), GFP_KERNEL);
+  if (!slab)
+    return NULL;
+
+  slab->vaddr = dma_alloc_wc(pool->dev, PAGE_SIZE, &slab->paddr, GFP_KERNEL);
+  if (!slab->vaddr) {
+    kfree(slab);
+    return NULL;
+  }
+
+  slab->pool = pool;
+  slab->obj_size = obj_size;
+  slab->nr_objs = PAGE_SIZE / obj_size;
+  return slab;
+}
+
+/*
+ * Take a free object of at least @size bytes, aligned to its size class.
+ * The object is cleared. Returns its slab and index within the slab.
+ */
+int32_t exslerate_slab_alloc(struct exslerate_slab_pool *pool, size_t size,
+                             struct exslerate_slab **slab, uint32_t *index) {
+  uint32_t shift, class, obj_size, idx;
+  struct exslerate_slab *iter, *found = NULL;
+
+  if (!size || size > EXSLERATE_SLAB_MAX_SIZE)
+    return -EINVAL;
+
+  shift = max_t(uint32_t, order_base_2(size), EXSLERATE_SLAB_MIN_SHIFT);
+  class = shift - EXSLERATE_SLAB_MIN_SHIFT;
+  obj_size = 1U << shift;
+
+  mutex_lock(&pool->lock);
+  list_for_each_entry(iter, &pool->slabs[class], link) {
+    if (iter->in_use < iter->nr_objs) {
+      found = iter;
+      break;
+    }
+  }
+
+  if (!found) {
+    found = exslerate_slab_create(pool, obj_size);
+    if (!found) {
+      mutex_unlock(&pool->lock);
+      return -ENOMEM;
+    }
+    list_add(&found->link, &pool->slabs[class]);
+  }
+
+  idx = find_first_zero_bit(found->used, found->nr_objs);
+  set_bit(idx, found->used);
+  found->in_use++;
+  kref_get(&pool->ref);
+  mutex_unlock(&pool->lock);
+
+  memset(found->vaddr + idx * obj_size, 0, obj_size);
+
+  *slab = found;
+  *index = idx;
+  return 0;
+}
+
+/* Release an object, and its slab page once the slab is empty */
+void exslerate_slab_free(struct exslerate_slab *slab, uint32_t index) {
+  struct exslerate_slab_pool *pool = slab->pool;
+
+  mutex_lock(&pool->lock);
+  clear_bit(index, slab->used);
+  if (--slab->in_use == 0) {
+    list_del(&slab->link);
+    dma_free_wc(pool->dev, PAGE_SIZE, slab->vaddr, slab->paddr);
+    kfree(slab);
+  }
+  mutex_unlock(&pool->lock);
+
+  exslerate_slab_pool_put(pool);
+}
@@ -0,0 +1,49 @@
+#ifndef _EXSLERATE_SLAB_H_
+#define _EXSLERATE_SLAB_H_
+
+#include <linux/bitmap.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+
+/*
+ * Size classes of the small-object slab, 64 B (the UDP DMA burst alignment)
+ * to 2 KiB. Each slab is one page of the reserved pool.
+ */
+#define EXSLERATE_SLAB_MIN_SHIFT 6
+#define EXSLERATE_SLAB_MAX_SHIFT 11
+#define EXSLERATE_SLAB_CLASSES                                                 \
+  (EXSLERATE_SLAB_MAX_SHIFT - EXSLERATE_SLAB_MIN_SHIFT + 1)
+#define EXSLERATE_SLAB_MAX_SIZE (1U << EXSLERATE_SLAB_MAX_SHIFT)
+#define EXSLERATE_SLAB_MAX_OBJS (PAGE_SIZE >> EXSLERATE_SLAB_MIN_SHIFT)
+
+/*
+ * Slabs of one drm_file. Small BOs are mapped by mapping their whole slab
+ * page, so pages are never shared between files.
+ */
+struct exslerate_slab_pool {
+  struct kref ref; /* Held by the file and by every object */
+  struct device *dev;
+  struct mutex lock; /* Protects the slab lists and bitmaps */
+  struct list_head slabs[EXSLERATE_SLAB_CLASSES];
+};
+
+struct exslerate_slab {
+  struct list_head link;
+  struct exslerate_slab_pool *pool;
+  void *vaddr;
+  dma_addr_t paddr;
+  uint32_t obj_size;
+  uint32_t nr_objs;
+  uint32_t in_use;
+  DECLARE_BITMAP(used, EXSLERATE_SLAB_MAX_OBJS);
+};
+
+struct exslerate_slab_pool *exslerate_slab_pool_create(struct device *dev);
+void exslerate_slab_pool_put(struct exslerate_slab_pool *pool);
+int32_t exslerate_slab_alloc(struct exslerate_slab_pool *pool, size_t size,
+                             struct exslerate_slab **slab, uint32_t *index);
+void exslerate_slab_free(struct exslerate_slab *slab, uint32_t index);
+
+#endif /* _EXSLERATE_SLAB_H_ */
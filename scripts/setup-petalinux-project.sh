@@ -170,6 +170,12 @@ add_userspace_app() {
   petalinux-create -t apps --template c --name runtime-test --enable
 }
 
+# Splits a 64-bit value into the two 32-bit cells of a DT reg entry.
+dt_cells() {
+  local value=$(( $1 ))
+  printf '0x%x 0x%x' $(( value >> 32 )) $(( value & 0xffffffff ))
+}
+
 # Applies the device tree overlay from the template.
 apply_device_tree() {
   local dtsi_template="${TEMPLATE_DIR}/system-user.dtsi"
@@ -185,8 +191,9 @@ apply_device_tree() {
   cp "$dtsi_template" "$dtsi_target"
 
   info "Replacing placeholders in device tree"
+  sed -i "s/__RESERVED_BASE_CELLS__/$(dt_cells "$RESERVED_BASE")/g" "$dtsi_target"
+  sed -i "s/__RESERVED_SIZE_CELLS__/$(dt_cells "$RESERVED_SIZE")/g" "$dtsi_target"
   sed -i "s/__RESERVED_BASE__/${RESERVED_BASE}/g" "$dtsi_target"
-  sed -i "s/__RESERVED_SIZE__/${RESERVED_SIZE}/g" "$dtsi_target"
 }
 
 # Builds the entire PetaLinux project.